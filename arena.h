@@ -13,257 +13,2614 @@
 #include <stdint.h>
 #include <stdalign.h>
 #include <stdbool.h>
+#include <string.h>
+#include <stdarg.h>
+
+// Remove if ARENA_ASSERT() is changed to not use assert()
+#include <assert.h>
 
 // Remove if not using malloc() and free() in the configuration
 #include <stdlib.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /// Configuration //////////////////////////////////////////////////////////////
 
 // Default way for arena to get memory
-static void* arena_default_mem_alloc(void* impl_data, size_t n){
+static inline void* arena_default_mem_alloc(void* impl_data, size_t n){
 	(void)impl_data; // Just so the compiler shuts up about it not being used
 	return malloc(n);
 }
 
 // Default way for arena to release memory
-static void arena_default_mem_free(void* impl_data, void* p){
+static inline void arena_default_mem_free(void* impl_data, void* p){
 	(void)impl_data; // Just so the compiler shuts up about it not being used
 	free(p);
 }
 
 /// How much to grow the arena (relative to required size) when making new blocks
+/// with the ARENA_GROWTH_GEOMETRIC policy and no factor given
 #define ARENA_GROW_FACTOR 1.25
 
-/// Helper macro, you can safely remove it if you don't want to use it
+/// How much to grow the arena (relative to the last block) when making new
+/// blocks with the ARENA_GROWTH_GEOMETRIC policy and no k given
+#define ARENA_GROW_LAST_FACTOR 2.0
+
+/// Largest block the ARENA_GROWTH_DOUBLE policy will create when no limit is
+/// given. Allocations bigger than this still get a block of their own.
+#define ARENA_GROW_MAX_BLOCK (64 * 1024 * 1024)
+
+/// Size of the first block made by ARENA_GROWTH_DOUBLE if the arena has none
+#define ARENA_GROW_MIN_BLOCK (4 * 1024)
+
+/// Blocks with less than this many bytes left are considered full and are no
+/// longer searched when the head block can't fit an allocation
+#define ARENA_OPEN_MIN_TAIL 64
+
+/// How many open blocks are tried before giving up and growing the arena
+#define ARENA_OPEN_SEARCH_LIMIT 4
+
+/// Platforms where arena_create_virtual() is available, remove to disable it
+#if defined(__unix__) || defined(__APPLE__)
+#define ARENA_VIRTUAL_MEMORY
+#endif
+
+/// Platforms where the huge page memory functions are available, remove to
+/// disable them
+#if defined(__linux__)
+#define ARENA_HUGE_PAGES
+#endif
+
+/// Size and alignment of huge pages used by arena_hugepage_mem_alloc()
+#define ARENA_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/// Default amount of memory committed at once by virtual memory arenas
+#define ARENA_VM_COMMIT_GRANULE (64 * 1024)
+
+/// Dirty ranges at least this big are zeroed by arena_reset_zero() by handing
+/// the pages back to the OS (MADV_DONTNEED) instead of memset()
+#define ARENA_ZERO_PURGE_MIN (256 * 1024)
+
+/// Number of thread local scratch arenas, must be greater than the number of
+/// conflicts passed to arena_scratch_begin()
+#define ARENA_SCRATCH_COUNT 2
+
+/// Capacity of the first block of each scratch arena
+#define ARENA_SCRATCH_CAPACITY (64 * 1024)
+
+#if defined(__cplusplus)
+#define ARENA_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#define ARENA_THREAD_LOCAL __declspec(thread)
+#else
+#define ARENA_THREAD_LOCAL _Thread_local
+#endif
+
+/// Size classes of struct ArenaBlockPool, class i holds blocks with a capacity
+/// of ARENA_POOL_MIN_BLOCK << i. Bigger blocks are never pooled.
+#define ARENA_POOL_CLASSES 16
+#define ARENA_POOL_MIN_BLOCK (4 * 1024)
+
+/// How much block capacity the thread local pool keeps at most
+#define ARENA_POOL_RETAIN (64 * 1024 * 1024)
+
+/// How many objects a struct ArenaPool takes from its arena at once
+#define ARENA_POOL_BATCH 64
+
+/// Number of size classes of struct ArenaSlab, from 16 to ARENA_SLAB_MAX bytes.
+/// Bigger allocations go straight to the arena.
+#define ARENA_SLAB_CLASSES 14
+#define ARENA_SLAB_MAX 2048
+
+/// Number of control bytes probed at once by struct ArenaMap, 16 matches an SSE2
+/// register
+#define ARENA_MAP_GROUP 16
+
+/// Checks preconditions such as alignments being powers of two, compiled out
+/// with NDEBUG. Define it as ((void)0) to always remove the checks.
+#define ARENA_ASSERT(x) assert(x)
+
+/// Helper macros, you can safely remove them if you don't want to use them.
+/// Size and alignment are constants here, so the fast path folds down to an
+/// add and a mask.
 #define arena_alloc(ar_ptr, T, n) \
 	(T *)(arena_alloc_raw((ar_ptr), (sizeof(T) * (n)), alignof(T)))
 
+// Like arena_alloc() but the memory is zeroed, see arena_alloc_zeroed()
+#define arena_calloc(ar_ptr, T, n) \
+	(T *)(arena_alloc_zeroed((ar_ptr), (sizeof(T) * (n)), alignof(T)))
+
+// Like arena_alloc() with a bigger alignment, align must be a power of two
+#define arena_alloc_aligned(ar_ptr, T, n, align) \
+	(T *)(arena_alloc_raw((ar_ptr), (sizeof(T) * (n)), \
+		((size_t)(align) > alignof(T)) ? (size_t)(align) : alignof(T)))
+
 /// Declarations ///////////////////////////////////////////////////////////////
 
 #define byte unsigned char
 
 typedef void* (*ArenaMemAllocProc) (void*, size_t);
 typedef void (*ArenaMemFreeProc) (void*, void*);
+typedef void (*ArenaFinalizerProc) (void*);
 
 struct ArenaBlock {
 	byte* data;
 	size_t offset;
 	size_t capacity;
+	size_t clean; // Bytes from max(clean, offset) on are known to be zero
+	bool kept; // Taken from the arena's spare blocks, rewinds put it back there
 
 	struct ArenaBlock* next;
+	struct ArenaBlock* next_open;
+};
+
+// How new blocks are sized when the arena has to grow. New blocks are never
+// smaller than what is needed to fit the allocation that triggered growth.
+enum ArenaGrowthKind {
+	ARENA_GROWTH_DOUBLE = 0, // Twice the last block, capped at size
+	ARENA_GROWTH_FIXED,      // Always blocks of size bytes
+	ARENA_GROWTH_GEOMETRIC,  // max(request * factor, last block * k)
+};
+
+struct ArenaGrowth {
+	enum ArenaGrowthKind kind;
+	size_t size;   // DOUBLE: block size limit, FIXED: chunk size
+	double factor; // GEOMETRIC: multiplier of the request
+	double k;      // GEOMETRIC: multiplier of the last block
+};
+
+// Cache of released blocks that arenas take from before calling mem_alloc,
+// so arenas that are created and destroyed over and over stop hitting the
+// system allocator. Arenas using a pool round block capacities up to its size
+// classes. Not thread safe, see arena_block_pool_thread().
+struct ArenaBlockPool {
+	ArenaMemAllocProc mem_alloc;
+	ArenaMemFreeProc mem_free;
+	void* impl_data;
+
+	size_t retain_limit; // Most block capacity kept, the rest is freed
+	size_t retained;     // Block capacity currently kept
+	struct ArenaBlock* free_blocks[ARENA_POOL_CLASSES];
+};
+
+struct ArenaConfig {
+	ArenaMemAllocProc mem_alloc;
+	ArenaMemFreeProc mem_free;
+	void* impl_data; // Passed to mem_alloc and mem_free
+	size_t capacity; // Capacity of the first block
+	struct ArenaGrowth growth;
+	struct ArenaBlockPool* pool; // Optional, replaces the memory functions
+	size_t retain_bytes; // If not 0, arena_reset() trims down to this much
+	bool mem_zeroed; // mem_alloc returns zeroed memory (mmap, calloc), ignored with a pool
 };
 
 struct ArenaAllocator {
 	ArenaMemAllocProc mem_alloc;
 	ArenaMemFreeProc mem_free;
+	void* impl_data; // Passed to mem_alloc and mem_free
 	struct ArenaBlock* head;
+	struct ArenaBlock* open; // Older blocks that still have usable space
+	struct ArenaBlock* spare; // Empty blocks kept by a reset, not in the block list
+	struct ArenaGrowth growth;
+	struct ArenaBlockPool* pool;
+	size_t retain_bytes;
+	bool mem_zeroed; // Blocks fresh from mem_alloc are zero
+
+	// Bump cursor and end of the head block, this is what the fast path works
+	// with. head->offset is only brought up to date when leaving the fast path.
+	uintptr_t cursor;
+	uintptr_t end;
+
+	// Bumped every time memory holding pool objects may be reused (reset, or a
+	// rewind past a pool refill), lets pools notice their free lists went stale.
+	// resets only counts resets and destroys, refills counts pool refills.
+	size_t generation;
+	size_t resets;
+	size_t refills;
+
+	// Finalizers registered with arena_add_finalizer(), newest first
+	struct ArenaFinalizer* finalizers;
+
+	// Virtual memory arenas have no blocks, end is the end of committed memory
+	bool is_virtual; // Made by arena_create_virtual(), even if reserving failed
+	byte* vm_base;
+	size_t vm_reserved;
+	size_t vm_committed;
+	size_t vm_granule;
+	size_t vm_clean; // Like ArenaBlock clean, offset from vm_base
+};
+
+#ifdef ARENA_HUGE_PAGES
+// Use as impl_data with arena_hugepage_mem_alloc() and arena_hugepage_mem_free().
+// The counters report how the memory currently mapped was obtained. Only
+// hugetlb_bytes is a guarantee: advised_bytes counts madvise(MADV_HUGEPAGE)
+// succeeding, which is a request the kernel may or may not honor when the pages
+// are touched. Use arena_hugepage_thp_bytes() to see what actually happened.
+struct ArenaHugePages {
+	bool use_hugetlb; // Try MAP_HUGETLB before transparent huge pages
+
+	size_t hugetlb_bytes;  // Explicit huge pages from MAP_HUGETLB, guaranteed
+	size_t advised_bytes;  // Transparent huge pages requested with madvise, not guaranteed
+	size_t fallback_bytes; // Neither worked, regular pages
+};
+
+// Memory functions for arenas that back blocks with huge pages. Blocks are
+// mapped ARENA_HUGE_PAGE_SIZE aligned and rounded up to a multiple of it, so
+// pair them with a capacity from arena_hugepage_capacity(). impl_data must
+// point to a struct ArenaHugePages. Falls back to regular pages when huge pages
+// are unavailable.
+void* arena_hugepage_mem_alloc(void* impl_data, size_t n);
+void arena_hugepage_mem_free(void* impl_data, void* p);
+
+// Largest block capacity that still maps to exactly npages huge pages, the
+// block and mapping headers come out of the first page
+size_t arena_hugepage_capacity(size_t npages);
+
+// Bytes of the mapping containing p currently backed by transparent huge
+// pages, from AnonHugePages in /proc/self/smaps. Pages only get backed once
+// touched. Slow, meant for checking a setup rather than hot paths. Returns 0
+// if smaps can't be read.
+size_t arena_hugepage_thp_bytes(void const* p);
+#endif
+
+// Savepoint of an arena, see arena_mark() and arena_rewind()
+struct ArenaMark {
+	struct ArenaBlock* block; // Head block when the mark was taken
+	uintptr_t cursor;
+	struct ArenaFinalizer* finalizers;
+	size_t refills;
 };
 
+// Node of the finalizer list, allocated in the arena it belongs to
+struct ArenaFinalizer {
+	ArenaFinalizerProc fn;
+	void* obj;
+	struct ArenaFinalizer* next;
+};
+
+// A mark together with its arena, see arena_scope()
+struct ArenaScope {
+	struct ArenaAllocator* arena;
+	struct ArenaMark mark;
+};
+
+// Initializes a block pool, NULL memory functions use the defaults.
+void arena_block_pool_init(struct ArenaBlockPool* pool, ArenaMemAllocProc alloc_proc, ArenaMemFreeProc free_proc, void* impl_data, size_t retain_limit);
+
+// Frees every block kept by the pool.
+void arena_block_pool_drain(struct ArenaBlockPool* pool);
+
+// Get the calling thread's pool, created on first use with the default memory
+// functions and ARENA_POOL_RETAIN. Arenas using it must be destroyed by the
+// same thread.
+struct ArenaBlockPool* arena_block_pool_thread(void);
+
 // Creates an arena.
 // Use alloc_proc = NULL and free_proc = NULL to use the default functions from
 // the Configuration section
 struct ArenaAllocator arena_create(ArenaMemAllocProc alloc_proc, ArenaMemFreeProc free_proc, size_t capacity);
 
+// Creates an arena from a configuration. A zeroed struct ArenaConfig is valid
+// and means default functions, no initial block and ARENA_GROWTH_DOUBLE growth.
+struct ArenaAllocator arena_create_ex(struct ArenaConfig const* cfg);
+
+// Creates an arena that reserves reserve bytes of address space up front and
+// commits pages granule bytes at a time (0 for ARENA_VM_COMMIT_GRANULE) as
+// allocations need them. The arena is one contiguous range that never moves
+// and never grows past reserve. On failure vm_base is NULL and every
+// allocation fails.
+struct ArenaAllocator arena_create_virtual(size_t reserve, size_t granule);
+
 // Destroys an arena, freeing all blocks.
 void arena_destroy(struct ArenaAllocator* ar);
 
 // Allocates a chunk of raw memory of size nbytes, pointer aligned to alignment
-// Will try to grow arena if needed. Returns NULL on failed allocation.
-void* arena_alloc_raw(struct ArenaAllocator* ar, size_t nbytes, size_t alignment);
+// which must be a power of two. Will try to grow arena if needed. Returns NULL
+// on failed allocation. The alignment is only checked by ARENA_ASSERT on the
+// fast path: with NDEBUG a bad alignment gives a misaligned pointer whenever
+// the allocation fits the head block, only arena_alloc_slow() rejects it.
+static inline void* arena_alloc_raw(struct ArenaAllocator* ar, size_t nbytes, size_t alignment);
+
+// Like arena_alloc_raw() but the memory is zeroed. Only bytes that were handed
+// out before (and given back by a reset, rewind or shrink) are cleared, memory
+// still fresh from a zeroing source is not touched again. Virtual memory and
+// huge page arenas are zeroed, for other memory functions see
+// ArenaConfig.mem_zeroed.
+void* arena_alloc_zeroed(struct ArenaAllocator* ar, size_t nbytes, size_t alignment);
+
+// Out of line part of arena_alloc_raw(), only called when the head block can't
+// fit the allocation. You should not need to call this directly.
+void* arena_alloc_slow(struct ArenaAllocator* ar, size_t nbytes, size_t alignment);
+
+// Resizes an allocation of old_size bytes made with the same alignment. If ptr
+// is the most recent allocation in the head block it is resized in place when
+// there is room, otherwise a new allocation is made and the contents copied.
+// ptr may be NULL. Returns NULL on failure (ptr stays valid) or if new_size
+// is 0.
+void* arena_realloc(struct ArenaAllocator* ar, void* ptr, size_t old_size, size_t new_size, size_t alignment);
+
+// Shrinks an allocation to new_size bytes, if ptr is the most recent
+// allocation in the head block the bytes past new_size are given back.
+void arena_shrink(struct ArenaAllocator* ar, void* ptr, size_t old_size, size_t new_size);
+
+// Grows an array of elem_size sized elements aligned to elem_align (a power of
+// two) so it can hold at least len + extra of them, capacity at least doubles.
+// Grows in place when data is the most recent allocation of the head block.
+// Returns the (possibly moved) data and updates *cap, on failure returns data
+// and leaves *cap unchanged.
+void* arena_array_grow(struct ArenaAllocator* ar, void* data, size_t len, size_t* cap, size_t extra, size_t elem_size, size_t elem_align);
+
+// Dynamic array of T allocated from an arena, declare a type for it with
+//   typedef ArenaArray(int) IntArray;
+#define ArenaArray(T) struct { T* data; size_t len; size_t cap; struct ArenaAllocator* arena; size_t align; }
+
+// T is the element type, its alignment is kept for growing
+//   arena_array_init(&arr, &ar, int);
+#define arena_array_init(arr_ptr, ar_ptr, T) \
+	((arr_ptr)->data = (T*)NULL, (arr_ptr)->len = 0, (arr_ptr)->cap = 0, (arr_ptr)->arena = (ar_ptr), \
+	 (arr_ptr)->align = alignof(T))
 
-// Resets arena, marking all blocks as free.
-// Does not release resources back
+// Make room for n more elements. Evaluates to false on failure. arr_ptr and n
+// are evaluated more than once.
+#define arena_array_reserve(arr_ptr, n) \
+	(((arr_ptr)->cap - (arr_ptr)->len >= (size_t)(n)) || \
+	 ((arr_ptr)->data = arena_array_grow((arr_ptr)->arena, (arr_ptr)->data, (arr_ptr)->len, \
+		&(arr_ptr)->cap, (n), sizeof(*(arr_ptr)->data), (arr_ptr)->align), \
+	  (arr_ptr)->cap - (arr_ptr)->len >= (size_t)(n)))
+
+// Append one element. Evaluates to false on failure.
+#define arena_array_push(arr_ptr, v) \
+	(arena_array_reserve((arr_ptr), 1) ? ((arr_ptr)->data[(arr_ptr)->len++] = (v), true) : false)
+
+// Append n elements copied from src. Evaluates to false on failure.
+#define arena_array_push_n(arr_ptr, src, n) \
+	(arena_array_reserve((arr_ptr), (n)) \
+		? (memcpy((arr_ptr)->data + (arr_ptr)->len, (src), sizeof(*(arr_ptr)->data) * (n)), (arr_ptr)->len += (n), true) \
+		: false)
+
+#define arena_array_pop(arr_ptr) ((arr_ptr)->data[--(arr_ptr)->len])
+
+// One region of arena_alloc_batch(), align must be a power of two
+struct ArenaAllocDesc {
+	size_t size;
+	size_t align;
+};
+
+// Initializer for a struct ArenaAllocDesc of n T's
+#define arena_desc(T, n) { sizeof(T) * (n), alignof(T) }
+
+// Allocates count regions with a single bump, laid out in order with only the
+// padding their alignments need. out_ptrs receives a pointer per region.
+// Returns false on failure, then out_ptrs is left untouched.
+bool arena_alloc_batch(struct ArenaAllocator* ar, struct ArenaAllocDesc const* descs, size_t count, void** out_ptrs);
+
+// Column of a struct of arrays, see arena_alloc_soa()
+struct ArenaColumn {
+	void** ptr;
+	size_t elem_size;
+	size_t elem_align;
+};
+
+// col is a T* that gets pointed at the column
+#define arena_column(col, T) { (void**)(1 ? &(col) : (T**)NULL), sizeof(T), alignof(T) }
+
+// Allocates n elements for each column with a single bump and points the
+// columns at them. Every column is aligned to at least align, which must be a
+// power of two (pass 1 for the elements' own alignment). Returns false on
+// failure.
+bool arena_alloc_columns(struct ArenaAllocator* ar, size_t n, size_t align, struct ArenaColumn const* cols, size_t count);
+
+// Shorthand for arena_alloc_columns() with the columns as arguments
+//   struct Particles { float* x; float* y; uint32_t* id; } p;
+//   arena_alloc_soa(&ar, n, 32, arena_column(p.x, float), arena_column(p.y, float),
+//                   arena_column(p.id, uint32_t));
+#ifndef __cplusplus
+#define arena_alloc_soa(ar_ptr, n, align, ...) \
+	arena_alloc_columns((ar_ptr), (n), (align), (struct ArenaColumn const[]){ __VA_ARGS__ }, \
+		sizeof((struct ArenaColumn const[]){ __VA_ARGS__ }) / sizeof(struct ArenaColumn))
+#endif
+
+// Allocates count rows of lengths[i] elements each, plus the array of row
+// pointers in front of them, with a single bump. Rows are aligned to
+// alignment. Returns the row pointers or NULL on failure.
+void** arena_alloc_jagged_raw(struct ArenaAllocator* ar, size_t const* lengths, size_t count, size_t elem_size, size_t alignment);
+
+#define arena_alloc_jagged(ar_ptr, T, lengths, count) \
+	(T **)(arena_alloc_jagged_raw((ar_ptr), (lengths), (count), sizeof(T), alignof(T)))
+
+// Resets arena, marking all blocks as free. The oldest block becomes the head,
+// the others are kept as spares that become the head again when it fills up.
+// Does not release resources back, unless the arena was created with
+// retain_bytes, then it behaves like arena_trim(ar, retain_bytes).
 void arena_reset(struct ArenaAllocator* ar);
 
+// Resets arena and frees blocks until at most keep_bytes of capacity are left,
+// newer (bigger) blocks are kept first. Virtual memory arenas decommit
+// everything past keep_bytes.
+void arena_trim(struct ArenaAllocator* ar, size_t keep_bytes);
+
+// Like arena_trim() but blocks over the budget are kept, their pages are
+// handed back to the OS with madvise() and come back on next use.
+void arena_trim_pages(struct ArenaAllocator* ar, size_t keep_bytes);
+
+// Resets arena and gives its memory back to the OS while keeping the address
+// space. Only virtual memory arenas decommit, others behave like arena_reset().
+void arena_reset_decommit(struct ArenaAllocator* ar);
+
+// Resets the arena and zeroes everything that was handed out, so later
+// arena_alloc_zeroed() calls don't have to. Large ranges of memory known to be
+// private anonymous mappings (default memory functions, huge pages, virtual
+// memory) are given back to the OS with MADV_DONTNEED on Linux and fault back
+// in as zero pages, the rest is cleared with memset().
+void arena_reset_zero(struct ArenaAllocator* ar);
+
 // Get combined capacity of all memory blocks available in the arena.
+// For virtual memory arenas this is the committed memory.
 size_t arena_total_capacity(struct ArenaAllocator const* ar);
 
-// Get how many memory blocks are in the arena.
+// Get how many memory blocks are in the arena. Always 0 for virtual memory
+// arenas.
 size_t arena_block_count(struct ArenaAllocator const* ar);
 
 // Push a new block to the arena. Can be used to preemptively reserve space.
+// Virtual memory arenas commit capacity bytes past the cursor instead.
 // Returns false on failure.
 bool arena_push_block(struct ArenaAllocator* ar, size_t capacity);
 
-/// Implementation /////////////////////////////////////////////////////////////
-#ifdef ARENA_IMPLEMENTATION
-static uintptr_t 
+// Get a savepoint of the current position of the arena.
+static inline struct ArenaMark arena_mark(struct ArenaAllocator const* ar);
+
+// Frees everything allocated after mark was taken, blocks pushed since then
+// are released (spares taken since then are kept as spares again). Runs the
+// finalizers added since the mark first. Marks must be
+// rewound in the reverse order they were taken and are invalidated by
+// arena_reset() and arena_destroy(). Allocations that went to the tail of an
+// older block are only reclaimed by arena_reset().
+void arena_rewind(struct ArenaAllocator* ar, struct ArenaMark mark);
+
+// Begin/end a temporary scope, arena_scope_end() rewinds to the beginning.
+static inline struct ArenaScope arena_scope_begin(struct ArenaAllocator* ar);
+static inline void arena_scope_end(struct ArenaScope* scope);
+
+#define ARENA_CONCAT_(a, b) a##b
+#define ARENA_CONCAT(a, b) ARENA_CONCAT_(a, b)
+
+// Rewinds the arena when the enclosing block is left. GCC/Clang only.
+//   { arena_scope(&ar); char* tmp = arena_alloc(&ar, char, 1024); ... }
+#if defined(__GNUC__) || defined(__clang__)
+#define arena_scope(ar_ptr) \
+	struct ArenaScope ARENA_CONCAT(arena_scope_, __LINE__) \
+		__attribute__((cleanup(arena_scope_end))) = arena_scope_begin(ar_ptr)
+#endif
+
+// Registers fn(obj) to run when the memory of obj is given back, that is on
+// arena_reset(), arena_trim(), arena_destroy() or when rewinding past the
+// point it was added. Finalizers run newest first, before any block is
+// released. The list node is allocated in the arena. Returns false on failure.
+bool arena_add_finalizer(struct ArenaAllocator* ar, ArenaFinalizerProc fn, void* obj);
+
+// Get one of the calling thread's scratch arenas that is none of the count
+// arenas in conflicts (NULL entries are ignored), pass the arenas the caller
+// is allocating its results into. Returns a scope with a NULL arena if all
+// scratch arenas conflict. Scratch arenas are created on first use.
+struct ArenaScope arena_scratch_begin(struct ArenaAllocator* const* conflicts, size_t count);
+
+// Rewind a scratch arena to where arena_scratch_begin() found it.
+static inline void arena_scratch_end(struct ArenaScope scope);
+
+// Destroys the calling thread's scratch arenas, call before a thread exits.
+void arena_scratch_release(void);
+
+// Shorthand for arena_scratch_begin() with conflicts as arguments
+//   struct ArenaScope tmp = arena_scratch(result_arena);
+#ifndef __cplusplus
+#define arena_scratch(...) \
+	arena_scratch_begin((struct ArenaAllocator* const[]){ NULL, __VA_ARGS__ }, \
+		sizeof((struct ArenaAllocator* const[]){ NULL, __VA_ARGS__ }) / sizeof(struct ArenaAllocator*))
+#endif
+
+#if !defined(__cplusplus) && !defined(__STDC_NO_ATOMICS__)
+#define ARENA_CONCURRENT
+#include <stdatomic.h>
+
+// Block of a concurrent arena, only the head block is allocated from
+struct ArenaConcurrentBlock {
+	byte* data;
+	atomic_size_t offset;
+	size_t capacity;
+
+	struct ArenaConcurrentBlock* next;
+};
+
+// Arena that many threads can allocate from at once. Allocation is a single
+// atomic_fetch_add on the head block's offset, when the head runs out a new
+// block is installed with a compare and swap on head.
+struct ArenaConcurrent {
+	ArenaMemAllocProc mem_alloc;
+	ArenaMemFreeProc mem_free;
+	void* impl_data;
+	struct ArenaGrowth growth;
+
+	_Atomic(struct ArenaConcurrentBlock*) head;
+};
+
+// Initializes a concurrent arena, same configuration as arena_create_ex().
+// Returns false if the initial block could not be allocated.
+bool arena_concurrent_init(struct ArenaConcurrent* ar, struct ArenaConfig const* cfg);
+
+// Thread safe version of arena_alloc_raw(). Allocation sizes are rounded up
+// to alignof(max_align_t). Returns NULL on failed allocation.
+void* arena_concurrent_alloc(struct ArenaConcurrent* ar, size_t nbytes, size_t alignment);
+
+// Resets the arena, keeping only the head block. NOT thread safe, no other
+// thread may be using the arena or memory allocated from it.
+void arena_concurrent_reset(struct ArenaConcurrent* ar);
+
+// Destroys the arena, freeing all blocks. NOT thread safe, no other thread
+// may be using the arena or memory allocated from it.
+void arena_concurrent_destroy(struct ArenaConcurrent* ar);
+
+// Get how many memory blocks are in the arena. Only exact when quiescent.
+size_t arena_concurrent_block_count(struct ArenaConcurrent* ar);
+
+// Memory functions that carve blocks out of the struct ArenaConcurrent given
+// as impl_data. Freeing does nothing, the memory goes back with the parent.
+void* arena_concurrent_mem_alloc(void* impl_data, size_t n);
+void arena_concurrent_mem_free(void* impl_data, void* p);
+
+// Creates a thread local allocation buffer (TLAB): a regular single threaded
+// arena whose blocks are chunk sized pieces of parent, so only refills touch
+// shared state. Each thread should have its own. TLABs must not be used after
+// the parent is reset or destroyed, destroying a TLAB is optional.
+struct ArenaAllocator arena_tlab_create(struct ArenaConcurrent* parent, size_t chunk);
+#endif /* ARENA_CONCURRENT */
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ARENA_PRINTF_FORMAT(fmt_idx, args_idx) __attribute__((format(printf, fmt_idx, args_idx)))
+#else
+#define ARENA_PRINTF_FORMAT(fmt_idx, args_idx)
+#endif
+
+// Null terminated string stored in an arena
+struct ArenaString {
+	char const* data;
+	size_t len;
+};
+
+// Builds a string at the end of an arena. While nothing else is allocated from
+// the arena the string is its most recent allocation and appends write
+// straight into the free tail. arena_sb_appendf() takes the whole free tail of
+// the head block until arena_sb_finish(). Allocating in between is fine, the
+// next append just has to copy.
+struct ArenaStringBuilder {
+	char* data;
+	size_t len;
+	size_t cap;
+	struct ArenaAllocator* arena;
+	size_t align;
+	size_t written; // Most bytes of data ever written, can be more than len
+};
+
+void arena_sb_init(struct ArenaStringBuilder* sb, struct ArenaAllocator* ar);
+
+// Append n bytes of str. Returns false on failure.
+bool arena_sb_append(struct ArenaStringBuilder* sb, char const* str, size_t n);
+
+// Append printf() formatted text. Returns false on failure.
+bool arena_sb_appendf(struct ArenaStringBuilder* sb, char const* fmt, ...) ARENA_PRINTF_FORMAT(2, 3);
+
+// Append count strings with sep between them. Returns false on failure.
+bool arena_sb_join(struct ArenaStringBuilder* sb, struct ArenaString const* parts, size_t count, char const* sep, size_t sep_len);
+
+// Null terminate the string, give unused capacity back to the arena and reset
+// the builder. data is NULL on failure.
+struct ArenaString arena_sb_finish(struct ArenaStringBuilder* sb);
+
+// FNV-1a hash of n bytes
+uint64_t arena_hash_bytes(void const* p, size_t n);
+
+// A string interned by a struct ArenaInterner. Interned strings are unique, so
+// they can be compared by str pointer.
+struct ArenaSymbol {
+	char const* str; // Null terminated
+	size_t len;
+	uint64_t hash;
+};
+
+// Deduplicates strings into an arena. The table itself lives in the arena
+// too, growing it allocates a new one and abandons the old.
+struct ArenaInterner {
+	struct ArenaSymbol* slots; // Open addressing, NULL str means empty
+	size_t cap;
+	size_t count;
+	struct ArenaAllocator* arena;
+};
+
+void arena_interner_init(struct ArenaInterner* in, struct ArenaAllocator* ar);
+
+// Get the interned copy of str, copying it in the arena the first time it is
+// seen. str of the result is NULL on failure.
+struct ArenaSymbol arena_intern(struct ArenaInterner* in, char const* str, size_t len);
+
+// Pool of fixed size objects with an intrusive free list, refilled from an
+// arena ARENA_POOL_BATCH objects at a time. Objects can be freed and reused
+// within the arena's lifetime. Resetting the arena, or rewinding it past a
+// refill, drops the free list, so the whole pool goes away with the arena.
+// Rewinds that don't reach back to a refill leave the pool alone.
+struct ArenaPool {
+	void* free_list;
+	size_t object_size;
+	size_t alignment;
+	size_t generation; // Arena generation the free list belongs to
+	size_t resets;     // Arena reset count the objects belong to
+	struct ArenaAllocator* arena;
+};
+
+// Creates a pool of objects of size bytes aligned to alignment.
+struct ArenaPool arena_pool_init(struct ArenaAllocator* ar, size_t size, size_t alignment);
+
+// Get an object from the pool. Returns NULL on failed allocation.
+static inline void* arena_pool_alloc(struct ArenaPool* pool);
+
+// Give an object back to the pool. Objects from before an arena reset are
+// ignored, objects whose memory was rewound must not be freed.
+static inline void arena_pool_free(struct ArenaPool* pool, void* p);
+
+// Out of line part of arena_pool_alloc(), only called when the free list is
+// empty or stale. You should not need to call this directly.
+void* arena_pool_refill(struct ArenaPool* pool);
+
+// Drops the free list if it went stale. Returns false if the arena was reset
+// since, then live objects are gone too. Used by the inline functions.
+bool arena_pool_sync(struct ArenaPool* pool);
+
+// General purpose small object allocator: one struct ArenaPool per size
+// class, all backed by the same arena. Allocations have a small header so
+// they can be freed without a size, like malloc() and free(). Everything is
+// released at once with the arena.
+struct ArenaSlab {
+	struct ArenaPool classes[ARENA_SLAB_CLASSES];
+	struct ArenaAllocator* arena;
+};
+
+void arena_slab_init(struct ArenaSlab* slab, struct ArenaAllocator* ar);
+
+// Allocate size bytes aligned to alignof(max_align_t). Returns NULL on failure.
+void* arena_slab_alloc(struct ArenaSlab* slab, size_t size);
+
+// Free memory from arena_slab_alloc(), p may be NULL.
+void arena_slab_free(struct ArenaSlab* slab, void* p);
+
+// Same as realloc(), contents are kept up to the smaller size. Returns NULL on
+// failure, p stays valid.
+void* arena_slab_realloc(struct ArenaSlab* slab, void* p, size_t size);
+
+typedef uint64_t (*ArenaMapHashProc)(void const* key, size_t key_size);
+typedef bool (*ArenaMapEqualProc)(void const* a, void const* b, size_t key_size);
+
+// Open addressing hash map (Swiss table layout) whose control bytes, keys and
+// values all live in an arena. Control bytes are probed ARENA_MAP_GROUP at a
+// time with SSE2 where available. Growing allocates a new table from the
+// arena and abandons the old one, there is nothing to free.
+struct ArenaMap {
+	uint8_t* ctrl;  // One per slot, empty, deleted or 7 bits of the hash
+	byte* slots;    // Key followed by value, slot_size bytes each
+	size_t cap;     // Multiple of ARENA_MAP_GROUP, power of two
+	size_t len;
+	size_t growth_left;
+
+	size_t key_size;
+	size_t value_size;
+	size_t value_offset;
+	size_t slot_size;
+	size_t slot_align;
+
+	ArenaMapHashProc hash; // NULL to hash the key's bytes
+	ArenaMapEqualProc eq;  // NULL to compare the key's bytes
+	struct ArenaAllocator* arena;
+};
+
+// Initializes an empty map, no memory is allocated until the first insertion.
+void arena_map_init(struct ArenaMap* m, struct ArenaAllocator* ar,
+	size_t key_size, size_t key_align, size_t value_size, size_t value_align,
+	ArenaMapHashProc hash, ArenaMapEqualProc eq);
+
+#define arena_map_init_typed(map_ptr, ar_ptr, K, V) \
+	arena_map_init((map_ptr), (ar_ptr), sizeof(K), alignof(K), sizeof(V), alignof(V), NULL, NULL)
+
+// Get a pointer to the value of key, NULL if it is not in the map.
+void* arena_map_get(struct ArenaMap const* m, void const* key);
+
+// Get a pointer to the value of key, inserting key with an uninitialized value
+// if it is missing. *inserted (may be NULL) tells which one happened. Returns
+// NULL on failed allocation.
+void* arena_map_put(struct ArenaMap* m, void const* key, bool* inserted);
+
+// Removes key from the map. Returns false if it was not there.
+bool arena_map_remove(struct ArenaMap* m, void const* key);
+
+#undef byte
+
+/// Inline fast path ///////////////////////////////////////////////////////////
+static inline bool
+arena_is_pow2(size_t a){
+	return a != 0 && (a & (a - 1)) == 0;
+}
+
+// a must be a power of two, this is a mask and not a division
+static inline uintptr_t
 align_forward_ptr(uintptr_t p, uintptr_t a){
-	uintptr_t mod = p % a;
+	ARENA_ASSERT(arena_is_pow2(a));
+	return (p + (a - 1)) & ~(a - 1);
+}
 
-	if(mod > 0){
-		p += (a - mod);
+// Size version of align_forward_ptr(), saturates to SIZE_MAX on overflow
+static inline size_t
+align_forward_size(size_t n, size_t a){
+	ARENA_ASSERT(arena_is_pow2(a));
+	if(n > SIZE_MAX - (a - 1)){ return SIZE_MAX; }
+	return (n + (a - 1)) & ~(a - 1);
+}
+
+static inline void*
+arena_alloc_raw(struct ArenaAllocator* ar, size_t nbytes, size_t alignment){
+	uintptr_t aligned = align_forward_ptr(ar->cursor, alignment);
+	uintptr_t next    = aligned + nbytes;
+
+	// next > aligned also rejects nbytes == 0 and overflow
+	if(next > aligned && next <= ar->end){
+		ar->cursor = next;
+		return (void*)aligned;
 	}
 
-	return p;
+	return arena_alloc_slow(ar, nbytes, alignment);
 }
 
-static size_t 
-align_forward_size(size_t p, size_t a){
-	size_t mod = p % a;
+static inline struct ArenaMark
+arena_mark(struct ArenaAllocator const* ar){
+	struct ArenaMark mark;
+	mark.block  = ar->head;
+	mark.cursor = ar->cursor;
+	mark.finalizers = ar->finalizers;
+	mark.refills = ar->refills;
+	return mark;
+}
 
-	if(mod > 0){
-		p += (a - mod);
-	}
+static inline struct ArenaScope
+arena_scope_begin(struct ArenaAllocator* ar){
+	struct ArenaScope scope;
+	scope.arena = ar;
+	scope.mark  = arena_mark(ar);
+	return scope;
+}
 
-	return p;
+static inline void
+arena_scope_end(struct ArenaScope* scope){
+	arena_rewind(scope->arena, scope->mark);
 }
 
-static struct ArenaBlock*
-arena_block_create(struct ArenaAllocator* ar, size_t capacity){
-	struct ArenaBlock *blk = ar->mem_alloc(NULL, sizeof(*blk));
-	if(blk == NULL){ return blk; }
+static inline void
+arena_scratch_end(struct ArenaScope scope){
+	if(scope.arena == NULL){ return; }
+	arena_rewind(scope.arena, scope.mark);
+}
 
-	void* data = ar->mem_alloc(NULL, capacity);
-	if(data == NULL){
-		ar->mem_free(NULL, blk);
-		return NULL;
+static inline void*
+arena_pool_alloc(struct ArenaPool* pool){
+	void** obj = (void**)pool->free_list;
+	if(obj != NULL && pool->generation == pool->arena->generation){
+		pool->free_list = *obj;
+		return obj;
 	}
+	return arena_pool_refill(pool);
+}
 
-	*blk = (struct ArenaBlock){
-		.capacity = capacity,
-		.offset = 0,
-		.data = data,
-		.next = NULL,
-	};
+static inline void
+arena_pool_free(struct ArenaPool* pool, void* p){
+	if(p == NULL){ return; }
+	// Objects from before a reset are gone with the rest of the arena
+	if(pool->generation != pool->arena->generation && !arena_pool_sync(pool)){ return; }
+	*(void**)p = pool->free_list;
+	pool->free_list = p;
+}
 
-	return blk;
+#ifdef __cplusplus
 }
+#endif
 
-struct ArenaAllocator
-arena_create(ArenaMemAllocProc mem_alloc_proc, ArenaMemFreeProc mem_free_proc, size_t capacity){
-	ArenaMemAllocProc alloc_proc = mem_alloc_proc;
-	ArenaMemFreeProc free_proc = mem_free_proc;
+/// Implementation /////////////////////////////////////////////////////////////
+#ifdef ARENA_IMPLEMENTATION
+#include <stdio.h>
 
-	if(alloc_proc == NULL){
-		alloc_proc = arena_default_mem_alloc;
-	}
-	if(free_proc == NULL){
-		free_proc = arena_default_mem_free;
-	}
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && ARENA_MAP_GROUP == 16
+#define ARENA_MAP_SSE2
+#include <emmintrin.h>
+#endif
 
-	struct ArenaAllocator ar = {
-		.mem_alloc = alloc_proc,
-		.mem_free = free_proc,
-	};
-	struct ArenaBlock* blk = arena_block_create(&ar, capacity);
+#define byte unsigned char
 
-	ar.head = blk;
+#ifdef ARENA_VIRTUAL_MEMORY
+#include <sys/mman.h>
+#include <unistd.h>
 
-	return ar;
+static size_t
+arena_os_page_size(void){
+	long n = sysconf(_SC_PAGESIZE);
+	return (n > 0) ? (size_t)n : 4096;
 }
 
-bool
-arena_push_block(struct ArenaAllocator* ar, size_t capacity){
-	struct ArenaBlock *blk = arena_block_create(ar, capacity);
-	if(blk == NULL){ return false; }
+static void*
+arena_os_reserve(size_t n){
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+	flags |= MAP_NORESERVE;
+#endif
+	void* p = mmap(NULL, n, PROT_NONE, flags, -1, 0);
+	return (p == MAP_FAILED) ? NULL : p;
+}
 
-	blk->next = ar->head;
-	ar->head = blk;
+static bool
+arena_os_commit(void* p, size_t n){
+	return mprotect(p, n, PROT_READ | PROT_WRITE) == 0;
+}
 
-	return true;
+// Returns true if the pages read back as zero once committed again
+static bool
+arena_os_decommit(void* p, size_t n){
+	bool dropped = madvise(p, n, MADV_DONTNEED) == 0;
+	mprotect(p, n, PROT_NONE);
+#if defined(__linux__)
+	return dropped;
+#else
+	(void)dropped;
+	return false;
+#endif
 }
 
-static uintptr_t
-arena_block_get_required(uintptr_t cur, size_t nbytes, size_t alignment){
-	uintptr_t aligned   = align_forward_ptr(cur, alignment);
-	uintptr_t padding   = (aligned - cur);
+static void
+arena_os_release(void* p, size_t n){
+	munmap(p, n);
+}
 
-	uintptr_t required  = padding + nbytes;
-	return required;
+static void
+arena_os_purge(void* p, size_t n){
+#ifdef MADV_FREE
+	madvise(p, n, MADV_FREE);
+#else
+	madvise(p, n, MADV_DONTNEED);
+#endif
 }
 
-static void*
-arena_block_alloc_raw(struct ArenaBlock* blk, size_t nbytes, size_t alignment){
-	uintptr_t base = (uintptr_t)blk->data;
-	uintptr_t cur = base + blk->offset;
+// Drop the pages of a private anonymous mapping so they fault back in as zero
+// pages. Only Linux guarantees that, returns false if the pages were kept.
+static bool
+arena_os_zero_pages(void* p, size_t n){
+#if defined(__linux__)
+	return madvise(p, n, MADV_DONTNEED) == 0;
+#else
+	(void)p; (void)n;
+	return false;
+#endif
+}
+#else
+static size_t arena_os_page_size(void){ return 4096; }
+static void* arena_os_reserve(size_t n){ (void)n; return NULL; }
+static bool arena_os_commit(void* p, size_t n){ (void)p; (void)n; return false; }
+static bool arena_os_decommit(void* p, size_t n){ (void)p; (void)n; return false; }
+static void arena_os_release(void* p, size_t n){ (void)p; (void)n; }
+static void arena_os_purge(void* p, size_t n){ (void)p; (void)n; }
+static bool arena_os_zero_pages(void* p, size_t n){ (void)p; (void)n; return false; }
+#endif /* ARENA_VIRTUAL_MEMORY */
 
-	uintptr_t available = blk->capacity - (cur - base);
-	uintptr_t required  = arena_block_get_required(cur, nbytes, alignment);
+#ifdef ARENA_HUGE_PAGES
+#include <sys/mman.h>
 
-	if(required > available){
-		return NULL;
-	}
+enum {
+	ARENA_HUGEPAGE_HUGETLB,
+	ARENA_HUGEPAGE_ADVISED,
+	ARENA_HUGEPAGE_FALLBACK,
+};
 
-	blk->offset += required;
-	return &blk->data[blk->offset - nbytes];
+// Stored at the start of the mapping, needed to unmap it and update counters
+struct ArenaHugePageHeader {
+	size_t size;
+	size_t kind;
+};
+
+#define ARENA_HUGEPAGE_HEADER_SIZE \
+	((sizeof(struct ArenaHugePageHeader) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1))
+
+static size_t*
+arena_hugepage_counter(struct ArenaHugePages* hp, size_t kind){
+	switch(kind){
+		case ARENA_HUGEPAGE_HUGETLB: return &hp->hugetlb_bytes;
+		case ARENA_HUGEPAGE_ADVISED: return &hp->advised_bytes;
+		default:                     return &hp->fallback_bytes;
+	}
 }
 
 void*
-arena_alloc_raw(struct ArenaAllocator* ar, size_t nbytes, size_t alignment){
-	if(nbytes == 0){ return NULL; }
-	struct ArenaBlock* blk = ar->head;
-	
-	while(blk != NULL){
-		void* p = arena_block_alloc_raw(blk, nbytes, alignment);
-		if(p != NULL){ return p; }
-		blk = blk->next;
+arena_hugepage_mem_alloc(void* impl_data, size_t n){
+	struct ArenaHugePages* hp = impl_data;
+	const size_t huge = ARENA_HUGE_PAGE_SIZE;
+
+	if(n > SIZE_MAX - ARENA_HUGEPAGE_HEADER_SIZE - 2 * huge){ return NULL; }
+	size_t size = ((n + ARENA_HUGEPAGE_HEADER_SIZE + huge - 1) / huge) * huge;
+	byte* base = NULL;
+	size_t kind = ARENA_HUGEPAGE_FALLBACK;
+
+#ifdef MAP_HUGETLB
+	if(hp->use_hugetlb){
+		void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if(p != MAP_FAILED){
+			base = p;
+			kind = ARENA_HUGEPAGE_HUGETLB;
+		}
 	}
+#endif
 
-	// No block with enough space found, create new one
-	size_t new_cap = align_forward_size(nbytes, alignment);
-	bool ok = arena_push_block(ar, new_cap * ARENA_GROW_FACTOR);
-	if(ok){
-		return arena_alloc_raw(ar, nbytes, alignment);
-	} else {
-		return NULL;
+	if(base == NULL){
+		// Over map and trim both ends so the mapping is huge page aligned
+		void* p = mmap(NULL, size + huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(p == MAP_FAILED){ return NULL; }
+
+		uintptr_t raw = (uintptr_t)p;
+		uintptr_t aligned = (raw + huge - 1) & ~(uintptr_t)(huge - 1);
+		if(aligned > raw){
+			munmap(p, aligned - raw);
+		}
+		if(aligned + size < raw + size + huge){
+			munmap((void*)(aligned + size), (raw + size + huge) - (aligned + size));
+		}
+		base = (byte*)aligned;
+
+#ifdef MADV_HUGEPAGE
+		if(madvise(base, size, MADV_HUGEPAGE) == 0){
+			kind = ARENA_HUGEPAGE_ADVISED;
+		}
+#endif
 	}
+
+	struct ArenaHugePageHeader* hdr = (struct ArenaHugePageHeader*)base;
+	hdr->size = size;
+	hdr->kind = kind;
+	*arena_hugepage_counter(hp, kind) += size;
+
+	return base + ARENA_HUGEPAGE_HEADER_SIZE;
 }
 
 void
-arena_reset(struct ArenaAllocator* ar){
-	struct ArenaBlock* cur = ar->head;
-	while(cur->next != NULL){
-		cur->offset = 0;
-		cur = cur->next;
-	}
-	cur->offset = 0;
-}
+arena_hugepage_mem_free(void* impl_data, void* p){
+	if(p == NULL){ return; }
+	struct ArenaHugePages* hp = impl_data;
 
-static void
-arena_block_destroy(struct ArenaAllocator* ar, struct ArenaBlock* b){
-	ar->mem_free(NULL, b->data);
-	ar->mem_free(NULL, b);
+	byte* base = (byte*)p - ARENA_HUGEPAGE_HEADER_SIZE;
+	struct ArenaHugePageHeader* hdr = (struct ArenaHugePageHeader*)base;
+	*arena_hugepage_counter(hp, hdr->kind) -= hdr->size;
+	munmap(base, hdr->size);
+}
+
+size_t
+arena_hugepage_thp_bytes(void const* p){
+	FILE* f = fopen("/proc/self/smaps", "r");
+	if(f == NULL){ return 0; }
+
+	uintptr_t addr = (uintptr_t)p;
+	bool inside = false;
+	size_t kb = 0;
+	char line[512];
+	while(fgets(line, sizeof(line), f) != NULL){
+		// Each mapping starts with its address range, its fields follow
+		unsigned long start = 0, end = 0;
+		if(sscanf(line, "%lx-%lx ", &start, &end) == 2){
+			inside = (addr >= start && addr < end);
+			continue;
+		}
+		if(inside && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1){ break; }
+	}
+	fclose(f);
+
+	return inside ? kb * 1024 : 0;
+}
+#endif /* ARENA_HUGE_PAGES */
+
+// Blocks are a single allocation, the header sits right before the data and
+// is padded so data keeps the alignment given by mem_alloc.
+#define ARENA_BLOCK_HEADER_SIZE \
+	((sizeof(struct ArenaBlock) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1))
+
+#ifdef ARENA_HUGE_PAGES
+size_t
+arena_hugepage_capacity(size_t npages){
+	const size_t headers = ARENA_HUGEPAGE_HEADER_SIZE + ARENA_BLOCK_HEADER_SIZE;
+	if(npages == 0 || npages > SIZE_MAX / ARENA_HUGE_PAGE_SIZE){ return 0; }
+	return npages * ARENA_HUGE_PAGE_SIZE - headers;
+}
+#endif
+
+void
+arena_block_pool_init(struct ArenaBlockPool* pool, ArenaMemAllocProc alloc_proc, ArenaMemFreeProc free_proc, void* impl_data, size_t retain_limit){
+	*pool = (struct ArenaBlockPool){
+		.mem_alloc = (alloc_proc != NULL) ? alloc_proc : arena_default_mem_alloc,
+		.mem_free = (free_proc != NULL) ? free_proc : arena_default_mem_free,
+		.impl_data = impl_data,
+		.retain_limit = retain_limit,
+	};
+}
+
+void
+arena_block_pool_drain(struct ArenaBlockPool* pool){
+	for(size_t i = 0; i < ARENA_POOL_CLASSES; i += 1){
+		struct ArenaBlock* blk = pool->free_blocks[i];
+		while(blk != NULL){
+			struct ArenaBlock* next = blk->next;
+			pool->mem_free(pool->impl_data, blk);
+			blk = next;
+		}
+		pool->free_blocks[i] = NULL;
+	}
+	pool->retained = 0;
+}
+
+static ARENA_THREAD_LOCAL struct ArenaBlockPool arena_thread_pool;
+
+struct ArenaBlockPool*
+arena_block_pool_thread(void){
+	struct ArenaBlockPool* pool = &arena_thread_pool;
+	if(pool->mem_alloc == NULL){
+		arena_block_pool_init(pool, NULL, NULL, NULL, ARENA_POOL_RETAIN);
+	}
+	return pool;
+}
+
+// Size class fitting capacity, ARENA_POOL_CLASSES if it's too big to pool
+static size_t
+arena_pool_class(size_t capacity){
+	size_t cls = 0;
+	while(cls < ARENA_POOL_CLASSES && ((size_t)ARENA_POOL_MIN_BLOCK << cls) < capacity){
+		cls += 1;
+	}
+	return cls;
+}
+
+// Give a block back to the pool, frees it if it isn't poolable or the pool is
+// over its limit
+static void
+arena_pool_give(struct ArenaBlockPool* pool, struct ArenaBlock* blk){
+	size_t cls = arena_pool_class(blk->capacity);
+	bool exact = (cls < ARENA_POOL_CLASSES) && (((size_t)ARENA_POOL_MIN_BLOCK << cls) == blk->capacity);
+
+	if(!exact || pool->retained + blk->capacity > pool->retain_limit){
+		pool->mem_free(pool->impl_data, blk);
+		return;
+	}
+
+	// Whoever gets the block next can still skip zeroing its clean tail
+	if(blk->offset > blk->clean){ blk->clean = blk->offset; }
+	blk->next = pool->free_blocks[cls];
+	pool->free_blocks[cls] = blk;
+	pool->retained += blk->capacity;
+}
+
+static struct ArenaBlock*
+arena_block_create(struct ArenaAllocator* ar, size_t capacity){
+	if(capacity > SIZE_MAX - ARENA_BLOCK_HEADER_SIZE){ return NULL; }
+
+	byte* mem = NULL;
+	size_t clean = capacity;
+	if(ar->pool != NULL){
+		size_t cls = arena_pool_class(capacity);
+		if(cls < ARENA_POOL_CLASSES){
+			capacity = (size_t)ARENA_POOL_MIN_BLOCK << cls;
+			clean = capacity;
+			mem = (byte*)ar->pool->free_blocks[cls];
+			if(mem != NULL){
+				ar->pool->free_blocks[cls] = ((struct ArenaBlock*)mem)->next;
+				ar->pool->retained -= capacity;
+				clean = ((struct ArenaBlock*)mem)->clean;
+			}
+		}
+	}
+
+	if(mem == NULL){
+		mem = ar->mem_alloc(ar->impl_data, ARENA_BLOCK_HEADER_SIZE + capacity);
+		if(ar->mem_zeroed){ clean = 0; }
+	}
+	if(mem == NULL){ return NULL; }
+
+	struct ArenaBlock *blk = (struct ArenaBlock*)mem;
+	*blk = (struct ArenaBlock){
+		.capacity = capacity,
+		.offset = 0,
+		.clean = clean,
+		.data = mem + ARENA_BLOCK_HEADER_SIZE,
+		.next = NULL,
+		.next_open = NULL,
+	};
+
+	return blk;
+}
+
+// Write the fast path cursor back into the head block
+static void
+arena_store_head(struct ArenaAllocator* ar){
+	if(ar->head == NULL){ return; }
+	ar->head->offset = ar->cursor - (uintptr_t)ar->head->data;
+}
+
+// The cursor is about to move back, everything it handed out may be dirty
+static void
+arena_mark_dirty(struct ArenaAllocator* ar){
+	if(ar->is_virtual){
+		size_t used = ar->cursor - (uintptr_t)ar->vm_base;
+		if(used > ar->vm_clean){ ar->vm_clean = used; }
+		return;
+	}
+	if(ar->head == NULL){ return; }
+	arena_store_head(ar);
+	if(ar->head->offset > ar->head->clean){ ar->head->clean = ar->head->offset; }
+}
+
+// Point the fast path cursor at the head block
+static void
+arena_load_head(struct ArenaAllocator* ar){
+	if(ar->head == NULL){
+		ar->cursor = 0;
+		ar->end = 0;
+		return;
+	}
+	ar->cursor = (uintptr_t)ar->head->data + ar->head->offset;
+	ar->end    = (uintptr_t)ar->head->data + ar->head->capacity;
+}
+
+struct ArenaAllocator
+arena_create_ex(struct ArenaConfig const* cfg){
+	ArenaMemAllocProc alloc_proc = cfg->mem_alloc;
+	ArenaMemFreeProc free_proc = cfg->mem_free;
+
+	if(alloc_proc == NULL){
+		alloc_proc = arena_default_mem_alloc;
+	}
+	if(free_proc == NULL){
+		free_proc = arena_default_mem_free;
+	}
+
+	struct ArenaAllocator ar = {
+		.mem_alloc = alloc_proc,
+		.mem_free = free_proc,
+		.impl_data = cfg->impl_data,
+		.growth = cfg->growth,
+		.pool = cfg->pool,
+		.retain_bytes = cfg->retain_bytes,
+	};
+
+	if(ar.pool != NULL){
+		ar.mem_alloc = ar.pool->mem_alloc;
+		ar.mem_free = ar.pool->mem_free;
+		ar.impl_data = ar.pool->impl_data;
+	} else {
+		ar.mem_zeroed = cfg->mem_zeroed;
+	}
+#ifdef ARENA_HUGE_PAGES
+	// Fresh mappings
+	if(ar.mem_alloc == arena_hugepage_mem_alloc){
+		ar.mem_zeroed = true;
+	}
+#endif
+
+	if(cfg->capacity > 0){
+		ar.head = arena_block_create(&ar, cfg->capacity);
+	}
+	arena_load_head(&ar);
+
+	return ar;
+}
+
+struct ArenaAllocator
+arena_create(ArenaMemAllocProc mem_alloc_proc, ArenaMemFreeProc mem_free_proc, size_t capacity){
+	struct ArenaConfig cfg = {
+		.mem_alloc = mem_alloc_proc,
+		.mem_free = mem_free_proc,
+		.capacity = capacity,
+	};
+	return arena_create_ex(&cfg);
+}
+
+static size_t
+arena_round_up(size_t n, size_t multiple){
+	size_t mod = n % multiple;
+	if(mod > 0){
+		if(n > SIZE_MAX - (multiple - mod)){ return SIZE_MAX; }
+		n += (multiple - mod);
+	}
+	return n;
+}
+
+struct ArenaAllocator
+arena_create_virtual(size_t reserve, size_t granule){
+	size_t page = arena_os_page_size();
+	if(granule == 0){
+		granule = ARENA_VM_COMMIT_GRANULE;
+	}
+
+	struct ArenaAllocator ar = {
+		.mem_alloc = arena_default_mem_alloc,
+		.mem_free = arena_default_mem_free,
+		.is_virtual = true,
+		.vm_reserved = arena_round_up(reserve, page),
+		.vm_granule = arena_round_up(granule, page),
+	};
+
+	// Nothing to reserve fails like a failed reservation
+	if(ar.vm_reserved > 0){
+		ar.vm_base = arena_os_reserve(ar.vm_reserved);
+	}
+	ar.cursor = (uintptr_t)ar.vm_base;
+	ar.end = ar.cursor;
+
+	return ar;
+}
+
+// Make sure the first size bytes of a virtual memory arena are committed
+static bool
+arena_vm_commit(struct ArenaAllocator* ar, size_t size){
+	if(ar->vm_base == NULL || size > ar->vm_reserved){ return false; }
+	if(size <= ar->vm_committed){ return true; }
+
+	size_t target = arena_round_up(size, ar->vm_granule);
+	if(target > ar->vm_reserved){
+		target = ar->vm_reserved;
+	}
+
+	if(!arena_os_commit(ar->vm_base + ar->vm_committed, target - ar->vm_committed)){
+		return false;
+	}
+
+	ar->vm_committed = target;
+	ar->end = (uintptr_t)ar->vm_base + target;
+	return true;
+}
+
+// Make blk the head, the old one goes to the open list if it has room left
+static void
+arena_link_head(struct ArenaAllocator* ar, struct ArenaBlock* blk){
+	arena_store_head(ar);
+	struct ArenaBlock* old = ar->head;
+	if(old != NULL && (old->capacity - old->offset) >= ARENA_OPEN_MIN_TAIL){
+		old->next_open = ar->open;
+		ar->open = old;
+	}
+
+	blk->next = ar->head;
+	ar->head = blk;
+	arena_load_head(ar);
+}
+
+bool
+arena_push_block(struct ArenaAllocator* ar, size_t capacity){
+	if(ar->is_virtual){
+		size_t used = ar->cursor - (uintptr_t)ar->vm_base;
+		if(capacity > SIZE_MAX - used){ return false; }
+		return arena_vm_commit(ar, used + capacity);
+	}
+
+	struct ArenaBlock *blk = arena_block_create(ar, capacity);
+	if(blk == NULL){ return false; }
+
+	arena_link_head(ar, blk);
+	return true;
+}
+
+static size_t
+arena_scale_size(size_t n, double factor){
+	double scaled = (double)n * factor;
+	if(scaled >= (double)(SIZE_MAX / 2)){ return SIZE_MAX / 2; }
+	return (size_t)scaled;
+}
+
+// Capacity of the block after one of last bytes according to the growth
+// policy, required is the minimum capacity needed for the allocation that
+// triggered growth.
+static size_t
+arena_growth_capacity(struct ArenaGrowth const* g, size_t last, size_t required){
+	size_t cap = 0;
+
+	switch(g->kind){
+		case ARENA_GROWTH_DOUBLE: {
+			size_t limit = (g->size > 0) ? g->size : ARENA_GROW_MAX_BLOCK;
+			if(last == 0){
+				cap = (limit < ARENA_GROW_MIN_BLOCK) ? limit : ARENA_GROW_MIN_BLOCK;
+			} else {
+				cap = (last > limit / 2) ? limit : last * 2;
+			}
+		} break;
+
+		case ARENA_GROWTH_FIXED: {
+			cap = g->size;
+		} break;
+
+		case ARENA_GROWTH_GEOMETRIC: {
+			double factor = (g->factor > 0) ? g->factor : ARENA_GROW_FACTOR;
+			double k = (g->k > 0) ? g->k : ARENA_GROW_LAST_FACTOR;
+			size_t from_request = arena_scale_size(required, factor);
+			size_t from_last = arena_scale_size(last, k);
+			cap = (from_request > from_last) ? from_request : from_last;
+		} break;
+	}
+
+	return (cap > required) ? cap : required;
+}
+
+static size_t
+arena_next_capacity(struct ArenaAllocator const* ar, size_t required){
+	size_t last = (ar->head != NULL) ? ar->head->capacity : 0;
+	return arena_growth_capacity(&ar->growth, last, required);
+}
+
+static uintptr_t
+arena_block_get_required(uintptr_t cur, size_t nbytes, size_t alignment){
+	uintptr_t aligned   = align_forward_ptr(cur, alignment);
+	uintptr_t padding   = (aligned - cur);
+
+	uintptr_t required  = padding + nbytes;
+	return required;
+}
+
+static void*
+arena_block_alloc_raw(struct ArenaBlock* blk, size_t nbytes, size_t alignment){
+	uintptr_t base = (uintptr_t)blk->data;
+	uintptr_t cur = base + blk->offset;
+
+	uintptr_t available = blk->capacity - (cur - base);
+	uintptr_t required  = arena_block_get_required(cur, nbytes, alignment);
+
+	if(required > available){
+		return NULL;
+	}
+
+	blk->offset += required;
+	return &blk->data[blk->offset - nbytes];
+}
+
+void*
+arena_alloc_slow(struct ArenaAllocator* ar, size_t nbytes, size_t alignment){
+	if(nbytes == 0 || !arena_is_pow2(alignment)){ return NULL; }
+
+	if(ar->is_virtual){
+		if(ar->vm_base == NULL){ return NULL; }
+		uintptr_t aligned = align_forward_ptr(ar->cursor, alignment);
+		size_t offset = aligned - (uintptr_t)ar->vm_base;
+		if(nbytes > SIZE_MAX - offset){ return NULL; }
+		if(!arena_vm_commit(ar, offset + nbytes)){ return NULL; }
+
+		ar->cursor = aligned + nbytes;
+		return (void*)aligned;
+	}
+
+	// Head is already known to be full, try the tails of older blocks (first
+	// fit). Blocks left with too little space are dropped from the search.
+	struct ArenaBlock** link = &ar->open;
+	for(int tries = 0; *link != NULL && tries < ARENA_OPEN_SEARCH_LIMIT; tries += 1){
+		struct ArenaBlock* blk = *link;
+		void* p = arena_block_alloc_raw(blk, nbytes, alignment);
+
+		if((blk->capacity - blk->offset) < ARENA_OPEN_MIN_TAIL){
+			*link = blk->next_open;
+		} else {
+			link = &blk->next_open;
+		}
+
+		if(p != NULL){ return p; }
+	}
+
+	// Data is only guaranteed malloc() alignment, so account for worst case
+	// padding when picking a block
+	if(nbytes > SIZE_MAX - alignment){ return NULL; }
+	size_t required = nbytes + (alignment - 1);
+
+	// Reuse a block kept by a reset (first fit), it becomes the head so the
+	// allocations after this one take the fast path again
+	struct ArenaBlock** spare = &ar->spare;
+	for(int tries = 0; *spare != NULL && tries < ARENA_OPEN_SEARCH_LIMIT; tries += 1){
+		if((*spare)->capacity >= required){ break; }
+		spare = &(*spare)->next;
+	}
+	if(*spare != NULL && (*spare)->capacity >= required){
+		struct ArenaBlock* blk = *spare;
+		*spare = blk->next;
+		blk->kept = true;
+		arena_link_head(ar, blk);
+	}
+	// No block with enough space found, create new one
+	else if(!arena_push_block(ar, arena_next_capacity(ar, required))){
+		return NULL;
+	}
+
+	uintptr_t aligned = align_forward_ptr(ar->cursor, alignment);
+	if(aligned + nbytes > ar->end){ return NULL; }
+
+	ar->cursor = aligned + nbytes;
+	return (void*)aligned;
+}
+
+// Run finalizers newest first until stop is reached
+static void
+arena_run_finalizers(struct ArenaAllocator* ar, struct ArenaFinalizer* stop){
+	while(ar->finalizers != NULL && ar->finalizers != stop){
+		struct ArenaFinalizer* fin = ar->finalizers;
+		ar->finalizers = fin->next;
+		fin->fn(fin->obj);
+	}
+}
+
+static void
+arena_reset_offsets(struct ArenaAllocator* ar){
+	ar->generation += 1;
+	ar->resets += 1;
+	arena_mark_dirty(ar);
+	if(ar->is_virtual){
+		ar->cursor = (uintptr_t)ar->vm_base;
+		return;
+	}
+
+	// The oldest block becomes the head, the others are kept as spares and
+	// come back as heads in the order they were first pushed
+	struct ArenaBlock* cur = ar->head;
+	while(cur != NULL){
+		struct ArenaBlock* next = cur->next;
+		if(cur->offset > cur->clean){ cur->clean = cur->offset; }
+		cur->offset = 0;
+		if(next != NULL){
+			cur->next = ar->spare;
+			ar->spare = cur;
+		} else {
+			ar->head = cur;
+		}
+		cur = next;
+	}
+	ar->open = NULL;
+	arena_load_head(ar);
+}
+
+static void arena_block_destroy(struct ArenaAllocator* ar, struct ArenaBlock* b);
+static void arena_release_list(struct ArenaAllocator* ar, struct ArenaBlock** link, size_t* budget, bool purge_only);
+
+// Release memory past keep_bytes, offsets must be reset afterwards
+static void
+arena_release_over(struct ArenaAllocator* ar, size_t keep_bytes, bool purge_only){
+	if(ar->is_virtual){
+		size_t keep = arena_round_up(keep_bytes, ar->vm_granule);
+		if(ar->vm_base == NULL || keep >= ar->vm_committed){ return; }
+
+		arena_mark_dirty(ar);
+		if(arena_os_decommit(ar->vm_base + keep, ar->vm_committed - keep) && ar->vm_clean > keep){
+			ar->vm_clean = keep;
+		}
+		ar->vm_committed = keep;
+		ar->end = (uintptr_t)ar->vm_base + keep;
+		if(ar->cursor > ar->end){ ar->cursor = ar->end; }
+		return;
+	}
+
+	// Blocks going back to a pool need their offset
+	arena_store_head(ar);
+	struct ArenaBlock* old_head = ar->head;
+	size_t budget = keep_bytes;
+	arena_release_list(ar, &ar->head, &budget, purge_only);
+	arena_release_list(ar, &ar->spare, &budget, purge_only);
+
+	// Never leave the cursor in a freed head, the next head kept its offset
+	if(ar->head != old_head){
+		arena_load_head(ar);
+	}
+}
+
+// Keeps the blocks of a list while they fit in *budget, the rest are freed or
+// with purge_only have their pages dropped
+static void
+arena_release_list(struct ArenaAllocator* ar, struct ArenaBlock** link, size_t* budget, bool purge_only){
+	size_t page = arena_os_page_size();
+	while(*link != NULL){
+		struct ArenaBlock* blk = *link;
+		if(blk->capacity <= *budget){
+			*budget -= blk->capacity;
+			link = &blk->next;
+		}
+		else if(purge_only){
+			uintptr_t start = align_forward_ptr((uintptr_t)blk->data, page);
+			uintptr_t stop = ((uintptr_t)blk->data + blk->capacity) & ~(uintptr_t)(page - 1);
+			if(stop > start){
+				arena_os_purge((void*)start, stop - start);
+			}
+			link = &blk->next;
+		}
+		else {
+			*link = blk->next;
+			arena_block_destroy(ar, blk);
+		}
+	}
+}
+
+void
+arena_shrink(struct ArenaAllocator* ar, void* ptr, size_t old_size, size_t new_size){
+	uintptr_t p = (uintptr_t)ptr;
+	if(new_size < old_size && p + old_size == ar->cursor){
+		arena_mark_dirty(ar);
+		ar->cursor = p + new_size;
+	}
+}
+
+void*
+arena_realloc(struct ArenaAllocator* ar, void* ptr, size_t old_size, size_t new_size, size_t alignment){
+	if(new_size == 0){
+		arena_shrink(ar, ptr, old_size, 0);
+		return NULL;
+	}
+	if(ptr == NULL){
+		return arena_alloc_raw(ar, new_size, alignment);
+	}
+	if(new_size <= old_size){
+		arena_shrink(ar, ptr, old_size, new_size);
+		return ptr;
+	}
+
+	// Grow in place if ptr is the last allocation of the head
+	uintptr_t p = (uintptr_t)ptr;
+	if(p + old_size == ar->cursor){
+		if(new_size <= ar->end - p){
+			ar->cursor = p + new_size;
+			return ptr;
+		}
+		if(ar->is_virtual){
+			size_t offset = p - (uintptr_t)ar->vm_base;
+			if(new_size <= SIZE_MAX - offset && arena_vm_commit(ar, offset + new_size)){
+				ar->cursor = p + new_size;
+				return ptr;
+			}
+			return NULL;
+		}
+	}
+
+	void* mem = arena_alloc_raw(ar, new_size, alignment);
+	if(mem == NULL){ return NULL; }
+	memcpy(mem, ptr, old_size);
+	return mem;
+}
+
+void*
+arena_array_grow(struct ArenaAllocator* ar, void* data, size_t len, size_t* cap, size_t extra, size_t elem_size, size_t elem_align){
+	if(!arena_is_pow2(elem_align)){ return data; }
+	if(extra > SIZE_MAX / elem_size - len){ return data; }
+
+	size_t new_cap = (*cap < SIZE_MAX / (2 * elem_size)) ? *cap * 2 : SIZE_MAX / elem_size;
+	if(new_cap < len + extra){ new_cap = len + extra; }
+	if(new_cap < 8){ new_cap = 8; }
+
+	void* mem = NULL;
+	if(data != NULL && (uintptr_t)data + (*cap * elem_size) == ar->cursor){
+		mem = arena_realloc(ar, data, *cap * elem_size, new_cap * elem_size, elem_align);
+	} else {
+		mem = arena_alloc_raw(ar, new_cap * elem_size, elem_align);
+		if(mem != NULL && len > 0){
+			memcpy(mem, data, len * elem_size);
+		}
+	}
+	if(mem == NULL){ return data; }
+
+	*cap = new_cap;
+	return mem;
+}
+
+// Places a region of size bytes after *total, returns its offset. *total
+// saturates to SIZE_MAX on overflow.
+static size_t
+arena_layout_push(size_t* total, size_t size, size_t align){
+	size_t offset = align_forward_size(*total, align);
+	*total = (size > SIZE_MAX - offset) ? SIZE_MAX : offset + size;
+	return offset;
+}
+
+bool
+arena_alloc_batch(struct ArenaAllocator* ar, struct ArenaAllocDesc const* descs, size_t count, void** out_ptrs){
+	if(count == 0){ return true; }
+
+	// The layout only holds if the base is aligned for every region
+	size_t total = 0;
+	size_t max_align = 1;
+	for(size_t i = 0; i < count; i += 1){
+		if(!arena_is_pow2(descs[i].align)){ return false; }
+		arena_layout_push(&total, descs[i].size, descs[i].align);
+		if(descs[i].align > max_align){ max_align = descs[i].align; }
+	}
+	if(total == SIZE_MAX){ return false; }
+
+	byte* base = arena_alloc_raw(ar, (total > 0) ? total : 1, max_align);
+	if(base == NULL){ return false; }
+
+	size_t offset = 0;
+	for(size_t i = 0; i < count; i += 1){
+		out_ptrs[i] = base + arena_layout_push(&offset, descs[i].size, descs[i].align);
+	}
+	return true;
+}
+
+bool
+arena_alloc_columns(struct ArenaAllocator* ar, size_t n, size_t align, struct ArenaColumn const* cols, size_t count){
+	if(count == 0){ return true; }
+	if(!arena_is_pow2(align)){ return false; }
+
+	size_t total = 0;
+	size_t max_align = align;
+	for(size_t i = 0; i < count; i += 1){
+		if(!arena_is_pow2(cols[i].elem_align)){ return false; }
+		size_t col_align = (cols[i].elem_align > align) ? cols[i].elem_align : align;
+		if(col_align > max_align){ max_align = col_align; }
+
+		if(n > SIZE_MAX / cols[i].elem_size){ return false; }
+		arena_layout_push(&total, n * cols[i].elem_size, col_align);
+	}
+	if(total == SIZE_MAX){ return false; }
+
+	byte* base = arena_alloc_raw(ar, (total > 0) ? total : 1, max_align);
+	if(base == NULL){ return false; }
+
+	size_t offset = 0;
+	for(size_t i = 0; i < count; i += 1){
+		size_t col_align = (cols[i].elem_align > align) ? cols[i].elem_align : align;
+		*cols[i].ptr = base + arena_layout_push(&offset, n * cols[i].elem_size, col_align);
+	}
+	return true;
+}
+
+void**
+arena_alloc_jagged_raw(struct ArenaAllocator* ar, size_t const* lengths, size_t count, size_t elem_size, size_t alignment){
+	if(!arena_is_pow2(alignment) || count > SIZE_MAX / sizeof(void*)){ return NULL; }
+
+	size_t total = count * sizeof(void*);
+	for(size_t i = 0; i < count; i += 1){
+		if(lengths[i] > SIZE_MAX / elem_size){ return NULL; }
+		arena_layout_push(&total, lengths[i] * elem_size, alignment);
+	}
+	if(total == SIZE_MAX){ return NULL; }
+
+	size_t base_align = (alignment > alignof(void*)) ? alignment : alignof(void*);
+	byte* base = arena_alloc_raw(ar, (total > 0) ? total : 1, base_align);
+	if(base == NULL){ return NULL; }
+
+	void** rows = (void**)base;
+	size_t offset = count * sizeof(void*);
+	for(size_t i = 0; i < count; i += 1){
+		rows[i] = base + arena_layout_push(&offset, lengths[i] * elem_size, alignment);
+	}
+	return rows;
+}
+
+void
+arena_reset(struct ArenaAllocator* ar){
+	arena_run_finalizers(ar, NULL);
+	if(ar->retain_bytes > 0){
+		arena_release_over(ar, ar->retain_bytes, false);
+	}
+	arena_reset_offsets(ar);
+}
+
+void
+arena_trim(struct ArenaAllocator* ar, size_t keep_bytes){
+	arena_run_finalizers(ar, NULL);
+	arena_release_over(ar, keep_bytes, false);
+	arena_reset_offsets(ar);
+}
+
+void
+arena_trim_pages(struct ArenaAllocator* ar, size_t keep_bytes){
+	arena_run_finalizers(ar, NULL);
+	arena_release_over(ar, keep_bytes, true);
+	arena_reset_offsets(ar);
+}
+
+static ARENA_THREAD_LOCAL struct ArenaAllocator arena_scratch_arenas[ARENA_SCRATCH_COUNT];
+
+struct ArenaScope
+arena_scratch_begin(struct ArenaAllocator* const* conflicts, size_t count){
+	struct ArenaScope scope = {0};
+
+	for(size_t i = 0; i < ARENA_SCRATCH_COUNT; i += 1){
+		struct ArenaAllocator* ar = &arena_scratch_arenas[i];
+		bool conflicting = false;
+		for(size_t c = 0; c < count; c += 1){
+			if(conflicts[c] == ar){
+				conflicting = true;
+				break;
+			}
+		}
+		if(conflicting){ continue; }
+
+		if(ar->mem_alloc == NULL){
+			*ar = arena_create(NULL, NULL, ARENA_SCRATCH_CAPACITY);
+		}
+		scope.arena = ar;
+		scope.mark = arena_mark(ar);
+		break;
+	}
+
+	return scope;
+}
+
+void
+arena_scratch_release(void){
+	for(size_t i = 0; i < ARENA_SCRATCH_COUNT; i += 1){
+		struct ArenaAllocator* ar = &arena_scratch_arenas[i];
+		if(ar->mem_alloc == NULL){ continue; }
+		arena_destroy(ar);
+		*ar = (struct ArenaAllocator){0};
+	}
+}
+
+void
+arena_reset_decommit(struct ArenaAllocator* ar){
+	if(ar->is_virtual){
+		arena_trim(ar, 0);
+	} else {
+		arena_reset(ar);
+	}
+}
+
+// Zero n bytes at p, dropping whole pages if allowed and worth it
+static void
+arena_zero_range(byte* p, size_t n, bool may_drop){
+	if(may_drop && n >= ARENA_ZERO_PURGE_MIN){
+		size_t page = arena_os_page_size();
+		uintptr_t start = align_forward_ptr((uintptr_t)p, page);
+		uintptr_t stop = ((uintptr_t)p + n) & ~(uintptr_t)(page - 1);
+		if(stop > start && arena_os_zero_pages((void*)start, stop - start)){
+			memset(p, 0, start - (uintptr_t)p);
+			memset((void*)stop, 0, ((uintptr_t)p + n) - stop);
+			return;
+		}
+	}
+	memset(p, 0, n);
+}
+
+void
+arena_reset_zero(struct ArenaAllocator* ar){
+	arena_reset(ar);
+
+	if(ar->is_virtual){
+		// Where decommitting doesn't drop pages the watermark can be past the
+		// committed memory, that part stays dirty
+		if(ar->vm_base != NULL && ar->vm_clean <= ar->vm_committed){
+			arena_zero_range(ar->vm_base, ar->vm_clean, true);
+			ar->vm_clean = 0;
+		}
+		return;
+	}
+
+	// Only memory known to be private anonymous mappings may have its pages
+	// dropped, anything else could read back the old contents
+	bool may_drop = (ar->mem_alloc == arena_default_mem_alloc);
+#ifdef ARENA_HUGE_PAGES
+	may_drop = may_drop || (ar->mem_alloc == arena_hugepage_mem_alloc);
+#endif
+
+	struct ArenaBlock* lists[] = { ar->head, ar->spare };
+	for(size_t i = 0; i < 2; i += 1){
+		for(struct ArenaBlock* blk = lists[i]; blk != NULL; blk = blk->next){
+			arena_zero_range(blk->data, blk->clean, may_drop);
+			blk->clean = 0;
+		}
+	}
+}
+
+void*
+arena_alloc_zeroed(struct ArenaAllocator* ar, size_t nbytes, size_t alignment){
+	byte* p = arena_alloc_raw(ar, nbytes, alignment);
+	if(p == NULL){ return NULL; }
+
+	// Bytes past the cursor and the clean watermark were never handed out.
+	// Allocations from the tail of an older block are zeroed in full.
+	uintptr_t start = (uintptr_t)p;
+	uintptr_t clean = start + nbytes;
+	if(ar->is_virtual){
+		clean = (uintptr_t)ar->vm_base + ar->vm_clean;
+	}
+	else if(ar->head != NULL && start >= (uintptr_t)ar->head->data && ar->cursor - start == nbytes){
+		clean = (uintptr_t)ar->head->data + ar->head->clean;
+	}
+
+	if(clean > start){
+		size_t dirty = clean - start;
+		memset(p, 0, (dirty < nbytes) ? dirty : nbytes);
+	}
+	return p;
+}
+
+static void
+arena_block_destroy(struct ArenaAllocator* ar, struct ArenaBlock* b){
+	if(ar->pool != NULL){
+		arena_pool_give(ar->pool, b);
+		return;
+	}
+	ar->mem_free(ar->impl_data, b);
+}
+
+// Remove blk from the open list, if it is there
+static void
+arena_open_unlink(struct ArenaAllocator* ar, struct ArenaBlock* blk){
+	struct ArenaBlock** link = &ar->open;
+	while(*link != NULL){
+		if(*link == blk){
+			*link = blk->next_open;
+			return;
+		}
+		link = &(*link)->next_open;
+	}
+}
+
+void
+arena_rewind(struct ArenaAllocator* ar, struct ArenaMark mark){
+	arena_run_finalizers(ar, mark.finalizers);
+	// Pools only lose their objects if one refilled after the mark
+	if(ar->refills != mark.refills){
+		ar->generation += 1;
+	}
+	if(ar->is_virtual){
+		if(mark.cursor < ar->cursor){
+			arena_mark_dirty(ar);
+			ar->cursor = mark.cursor;
+		}
+		return;
+	}
+
+	// Release blocks pushed after the mark
+	arena_store_head(ar);
+	bool popped = false;
+	while(ar->head != NULL && ar->head != mark.block){
+		struct ArenaBlock* blk = ar->head;
+		ar->head = blk->next;
+		arena_open_unlink(ar, blk);
+		if(blk->kept){
+			if(blk->offset > blk->clean){ blk->clean = blk->offset; }
+			blk->offset = 0;
+			blk->next = ar->spare;
+			ar->spare = blk;
+		} else {
+			arena_block_destroy(ar, blk);
+		}
+		popped = true;
+	}
+	if(ar->head == NULL){
+		arena_load_head(ar);
+		return;
+	}
+
+	// If blocks were pushed, the marked block may have gone to the open list,
+	// make it current again. Otherwise it never left the head position.
+	if(popped){
+		arena_open_unlink(ar, ar->head);
+	}
+	if(ar->head->offset > ar->head->clean){ ar->head->clean = ar->head->offset; }
+	ar->head->offset = mark.cursor - (uintptr_t)ar->head->data;
+	arena_load_head(ar);
+}
+
+bool
+arena_add_finalizer(struct ArenaAllocator* ar, ArenaFinalizerProc fn, void* obj){
+	struct ArenaFinalizer* fin = arena_alloc(ar, struct ArenaFinalizer, 1);
+	if(fin == NULL){ return false; }
+	fin->fn = fn;
+	fin->obj = obj;
+	fin->next = ar->finalizers;
+	ar->finalizers = fin;
+	return true;
 }
 
 void
 arena_destroy(struct ArenaAllocator* ar){
-	struct ArenaBlock* cur = ar->head;
-	struct ArenaBlock* next = NULL;
-	while(cur->next != NULL){
-		next = cur->next;
-		arena_block_destroy(ar, cur);
-		cur = next;
+	arena_run_finalizers(ar, NULL);
+	ar->generation += 1;
+	ar->resets += 1;
+	if(ar->is_virtual){
+		if(ar->vm_base != NULL){
+			arena_os_release(ar->vm_base, ar->vm_reserved);
+		}
+		ar->vm_base = NULL;
+		ar->vm_committed = 0;
+		ar->cursor = 0;
+		ar->end = 0;
+		return;
+	}
+
+	arena_store_head(ar);
+	struct ArenaBlock* lists[] = { ar->head, ar->spare };
+	for(size_t i = 0; i < 2; i += 1){
+		struct ArenaBlock* cur = lists[i];
+		while(cur != NULL){
+			struct ArenaBlock* next = cur->next;
+			arena_block_destroy(ar, cur);
+			cur = next;
+		}
 	}
-	arena_block_destroy(ar, cur);
 	ar->head = NULL;
+	ar->open = NULL;
+	ar->spare = NULL;
+	arena_load_head(ar);
 }
 
 size_t
 arena_block_count(struct ArenaAllocator const* ar){
-	struct ArenaBlock* blk = ar->head;
 	size_t total = 0;
-
-	while(blk != NULL){
+	for(struct ArenaBlock* blk = ar->head; blk != NULL; blk = blk->next){
+		total += 1;
+	}
+	for(struct ArenaBlock* blk = ar->spare; blk != NULL; blk = blk->next){
 		total += 1;
-		blk = blk->next;
 	}
-
 	return total;
 }
 
 size_t
 arena_total_capacity(struct ArenaAllocator const* ar){
-	struct ArenaBlock* blk = ar->head;
+	if(ar->is_virtual){ return ar->vm_committed; }
+
+	size_t total = 0;
+	for(struct ArenaBlock* blk = ar->head; blk != NULL; blk = blk->next){
+		total += blk->capacity;
+	}
+	for(struct ArenaBlock* blk = ar->spare; blk != NULL; blk = blk->next){
+		total += blk->capacity;
+	}
+	return total;
+}
+
+void
+arena_sb_init(struct ArenaStringBuilder* sb, struct ArenaAllocator* ar){
+	arena_array_init(sb, ar, char);
+	sb->written = 0;
+}
+
+bool
+arena_sb_append(struct ArenaStringBuilder* sb, char const* str, size_t n){
+	// Always keep room for the terminator
+	if(n == SIZE_MAX || !arena_array_reserve(sb, n + 1)){ return false; }
+	memcpy(sb->data + sb->len, str, n);
+	sb->len += n;
+	return true;
+}
+
+// If the builder is the most recent allocation of the head block, take the
+// rest of the block too
+static void
+arena_sb_grab_tail(struct ArenaStringBuilder* sb){
+	struct ArenaAllocator* ar = sb->arena;
+	if(sb->data != NULL && (uintptr_t)(sb->data + sb->cap) == ar->cursor){
+		sb->cap += ar->end - ar->cursor;
+		ar->cursor = ar->end;
+	}
+}
+
+bool
+arena_sb_appendf(struct ArenaStringBuilder* sb, char const* fmt, ...){
+	if(!arena_array_reserve(sb, 1)){ return false; }
+	arena_sb_grab_tail(sb);
+
+	va_list args;
+	va_start(args, fmt);
+	size_t avail = sb->cap - sb->len;
+	int n = vsnprintf(sb->data + sb->len, avail, fmt, args);
+	va_end(args);
+
+	// Truncated output still fills the buffer
+	size_t wrote = (n >= 0 && (size_t)n < avail) ? (size_t)n + 1 : avail;
+	if(sb->len + wrote > sb->written){ sb->written = sb->len + wrote; }
+	if(n < 0){ return false; }
+
+	// Did not fit, make room and format again
+	if((size_t)n >= avail){
+		if(!arena_array_reserve(sb, (size_t)n + 1)){ return false; }
+		va_start(args, fmt);
+		vsnprintf(sb->data + sb->len, sb->cap - sb->len, fmt, args);
+		va_end(args);
+		if(sb->len + (size_t)n + 1 > sb->written){ sb->written = sb->len + (size_t)n + 1; }
+	}
+
+	sb->len += (size_t)n;
+	return true;
+}
+
+bool
+arena_sb_join(struct ArenaStringBuilder* sb, struct ArenaString const* parts, size_t count, char const* sep, size_t sep_len){
+	// Reserve everything up front so it's at most one copy
+	size_t total = 1;
+	for(size_t i = 0; i < count; i += 1){
+		total += parts[i].len + sep_len;
+	}
+	if(!arena_array_reserve(sb, total)){ return false; }
+
+	for(size_t i = 0; i < count; i += 1){
+		if(i > 0){
+			memcpy(sb->data + sb->len, sep, sep_len);
+			sb->len += sep_len;
+		}
+		memcpy(sb->data + sb->len, parts[i].data, parts[i].len);
+		sb->len += parts[i].len;
+	}
+	return true;
+}
+
+struct ArenaString
+arena_sb_finish(struct ArenaStringBuilder* sb){
+	struct ArenaString res = {0};
+	if(arena_array_reserve(sb, 1)){
+		sb->data[sb->len] = 0;
+
+		// Give back the never written part of a grabbed tail first, so the
+		// shrink doesn't count it as dirty for arena_alloc_zeroed()
+		struct ArenaAllocator* ar = sb->arena;
+		size_t written = (sb->written > sb->len + 1) ? sb->written : sb->len + 1;
+		if((uintptr_t)(sb->data + sb->cap) == ar->cursor && written < sb->cap){
+			ar->cursor = (uintptr_t)(sb->data + written);
+			sb->cap = written;
+		}
+		arena_shrink(ar, sb->data, sb->cap, sb->len + 1);
+		res.data = sb->data;
+		res.len = sb->len;
+	}
+
+	arena_sb_init(sb, sb->arena);
+	return res;
+}
+
+uint64_t
+arena_hash_bytes(void const* p, size_t n){
+	byte const* b = p;
+	uint64_t h = 0xcbf29ce484222325ull;
+	for(size_t i = 0; i < n; i += 1){
+		h ^= b[i];
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+void
+arena_interner_init(struct ArenaInterner* in, struct ArenaAllocator* ar){
+	*in = (struct ArenaInterner){ .arena = ar };
+}
+
+// Slot where a string with this hash and contents is, or should go
+static struct ArenaSymbol*
+arena_interner_find(struct ArenaSymbol* slots, size_t cap, char const* str, size_t len, uint64_t hash){
+	size_t mask = cap - 1;
+	size_t i = (size_t)hash & mask;
+	for(;;){
+		struct ArenaSymbol* slot = &slots[i];
+		if(slot->str == NULL){ return slot; }
+		if(slot->hash == hash && slot->len == len && memcmp(slot->str, str, len) == 0){
+			return slot;
+		}
+		i = (i + 1) & mask;
+	}
+}
+
+static bool
+arena_interner_grow(struct ArenaInterner* in){
+	size_t new_cap = (in->cap > 0) ? in->cap * 2 : 64;
+	struct ArenaSymbol* slots = arena_alloc(in->arena, struct ArenaSymbol, new_cap);
+	if(slots == NULL){ return false; }
+	memset(slots, 0, sizeof(*slots) * new_cap);
+
+	for(size_t i = 0; i < in->cap; i += 1){
+		struct ArenaSymbol* old = &in->slots[i];
+		if(old->str == NULL){ continue; }
+		*arena_interner_find(slots, new_cap, old->str, old->len, old->hash) = *old;
+	}
+
+	in->slots = slots;
+	in->cap = new_cap;
+	return true;
+}
+
+struct ArenaSymbol
+arena_intern(struct ArenaInterner* in, char const* str, size_t len){
+	struct ArenaSymbol res = {0};
+	uint64_t hash = arena_hash_bytes(str, len);
+
+	// Keep the load factor under 1/2
+	if((in->count + 1) * 2 > in->cap && !arena_interner_grow(in)){
+		return res;
+	}
+
+	struct ArenaSymbol* slot = arena_interner_find(in->slots, in->cap, str, len, hash);
+	if(slot->str != NULL){
+		return *slot;
+	}
+
+	char* copy = arena_alloc_raw(in->arena, len + 1, 1);
+	if(copy == NULL){ return res; }
+	memcpy(copy, str, len);
+	copy[len] = 0;
+
+	*slot = (struct ArenaSymbol){ .str = copy, .len = len, .hash = hash };
+	in->count += 1;
+	return *slot;
+}
+
+enum {
+	ARENA_MAP_EMPTY   = 0x80,
+	ARENA_MAP_DELETED = 0xfe,
+};
+
+// Bit i set for every control byte i of the group equal to c
+static uint32_t
+arena_map_group_match(uint8_t const* group, uint8_t c){
+#ifdef ARENA_MAP_SSE2
+	__m128i ctrl = _mm_loadu_si128((__m128i const*)group);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)c)));
+#else
+	uint32_t mask = 0;
+	for(int i = 0; i < ARENA_MAP_GROUP; i += 1){
+		mask |= (uint32_t)(group[i] == c) << i;
+	}
+	return mask;
+#endif
+}
+
+// Bit i set for every empty or deleted control byte i of the group
+static uint32_t
+arena_map_group_free(uint8_t const* group){
+#ifdef ARENA_MAP_SSE2
+	return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((__m128i const*)group));
+#else
+	uint32_t mask = 0;
+	for(int i = 0; i < ARENA_MAP_GROUP; i += 1){
+		mask |= (uint32_t)(group[i] >> 7) << i;
+	}
+	return mask;
+#endif
+}
+
+static int
+arena_map_lowest_bit(uint32_t mask){
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctz(mask);
+#else
+	int i = 0;
+	while(!(mask & 1)){ mask >>= 1; i += 1; }
+	return i;
+#endif
+}
+
+static uint64_t
+arena_map_hash(struct ArenaMap const* m, void const* key){
+	uint64_t h = (m->hash != NULL) ? m->hash(key, m->key_size) : arena_hash_bytes(key, m->key_size);
+	// Finalizer from MurmurHash3, both ends of the hash get used
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+static bool
+arena_map_key_eq(struct ArenaMap const* m, void const* a, void const* b){
+	if(m->eq != NULL){ return m->eq(a, b, m->key_size); }
+	return memcmp(a, b, m->key_size) == 0;
+}
+
+struct ArenaPool
+arena_pool_init(struct ArenaAllocator* ar, size_t size, size_t alignment){
+	// Free objects hold the free list link
+	if(alignment < alignof(void*)){ alignment = alignof(void*); }
+	if(size < sizeof(void*)){ size = sizeof(void*); }
+
+	struct ArenaPool pool = {
+		.object_size = align_forward_size(size, alignment),
+		.alignment = alignment,
+		.generation = ar->generation,
+		.resets = ar->resets,
+		.arena = ar,
+	};
+	return pool;
+}
+
+bool
+arena_pool_sync(struct ArenaPool* pool){
+	struct ArenaAllocator* ar = pool->arena;
+	if(pool->generation == ar->generation){ return true; }
+
+	pool->free_list = NULL;
+	pool->generation = ar->generation;
+	bool live = (pool->resets == ar->resets);
+	pool->resets = ar->resets;
+	return live;
+}
+
+void*
+arena_pool_refill(struct ArenaPool* pool){
+	struct ArenaAllocator* ar = pool->arena;
+	arena_pool_sync(pool);
+	if(pool->free_list != NULL){
+		return arena_pool_alloc(pool);
+	}
+
+	size_t size = pool->object_size;
+	size_t count = ARENA_POOL_BATCH;
+	byte* objs = NULL;
+	if(size <= SIZE_MAX / count){
+		objs = arena_alloc_raw(ar, size * count, pool->alignment);
+	}
+	if(objs == NULL){
+		count = 1;
+		objs = arena_alloc_raw(ar, size, pool->alignment);
+		if(objs == NULL){ return NULL; }
+	}
+
+	// Rewinding to a mark taken before this point drops the batch
+	ar->refills += 1;
+
+	// First object goes to the caller, the rest are linked up
+	for(size_t i = count - 1; i > 0; i -= 1){
+		void* obj = objs + i * size;
+		*(void**)obj = pool->free_list;
+		pool->free_list = obj;
+	}
+	return objs;
+}
+
+static const size_t arena_slab_sizes[ARENA_SLAB_CLASSES] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, ARENA_SLAB_MAX,
+};
+
+// Stored before every slab allocation
+struct ArenaSlabHeader {
+	size_t size_class; // ARENA_SLAB_CLASSES for allocations made from the arena
+	size_t size;       // Usable size
+};
+
+#define ARENA_SLAB_HEADER_SIZE \
+	((sizeof(struct ArenaSlabHeader) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1))
+
+void
+arena_slab_init(struct ArenaSlab* slab, struct ArenaAllocator* ar){
+	slab->arena = ar;
+	for(size_t i = 0; i < ARENA_SLAB_CLASSES; i += 1){
+		slab->classes[i] = arena_pool_init(ar, ARENA_SLAB_HEADER_SIZE + arena_slab_sizes[i], alignof(max_align_t));
+	}
+}
+
+void*
+arena_slab_alloc(struct ArenaSlab* slab, size_t size){
+	size_t cls = 0;
+	while(cls < ARENA_SLAB_CLASSES && arena_slab_sizes[cls] < size){
+		cls += 1;
+	}
+
+	byte* mem = NULL;
+	if(cls < ARENA_SLAB_CLASSES){
+		mem = arena_pool_alloc(&slab->classes[cls]);
+		size = arena_slab_sizes[cls];
+	} else if(size <= SIZE_MAX - ARENA_SLAB_HEADER_SIZE){
+		mem = arena_alloc_raw(slab->arena, ARENA_SLAB_HEADER_SIZE + size, alignof(max_align_t));
+	}
+	if(mem == NULL){ return NULL; }
+
+	struct ArenaSlabHeader* hdr = (struct ArenaSlabHeader*)mem;
+	hdr->size_class = cls;
+	hdr->size = size;
+	return mem + ARENA_SLAB_HEADER_SIZE;
+}
+
+void
+arena_slab_free(struct ArenaSlab* slab, void* p){
+	if(p == NULL){ return; }
+	byte* mem = (byte*)p - ARENA_SLAB_HEADER_SIZE;
+	struct ArenaSlabHeader* hdr = (struct ArenaSlabHeader*)mem;
+
+	if(hdr->size_class < ARENA_SLAB_CLASSES){
+		arena_pool_free(&slab->classes[hdr->size_class], mem);
+	} else {
+		// Only reclaimed if it is the last thing allocated
+		arena_shrink(slab->arena, mem, ARENA_SLAB_HEADER_SIZE + hdr->size, 0);
+	}
+}
+
+void*
+arena_slab_realloc(struct ArenaSlab* slab, void* p, size_t size){
+	if(p == NULL){ return arena_slab_alloc(slab, size); }
+
+	struct ArenaSlabHeader* hdr = (struct ArenaSlabHeader*)((byte*)p - ARENA_SLAB_HEADER_SIZE);
+	if(size <= hdr->size){ return p; }
+
+	void* mem = arena_slab_alloc(slab, size);
+	if(mem == NULL){ return NULL; }
+	memcpy(mem, p, hdr->size);
+	arena_slab_free(slab, p);
+	return mem;
+}
+
+void
+arena_map_init(struct ArenaMap* m, struct ArenaAllocator* ar,
+	size_t key_size, size_t key_align, size_t value_size, size_t value_align,
+	ArenaMapHashProc hash, ArenaMapEqualProc eq)
+{
+	size_t align = (key_align > value_align) ? key_align : value_align;
+	size_t value_offset = align_forward_size(key_size, value_align);
+
+	*m = (struct ArenaMap){
+		.key_size = key_size,
+		.value_size = value_size,
+		.value_offset = value_offset,
+		.slot_size = align_forward_size(value_offset + value_size, align),
+		.slot_align = align,
+		.hash = hash,
+		.eq = eq,
+		.arena = ar,
+	};
+}
+
+// Index of the slot holding key, cap if it isn't there
+static size_t
+arena_map_find(struct ArenaMap const* m, void const* key, uint64_t hash){
+	if(m->cap == 0){ return 0; }
+
+	size_t group_mask = m->cap / ARENA_MAP_GROUP - 1;
+	size_t g = (size_t)(hash >> 7) & group_mask;
+	uint8_t h2 = (uint8_t)(hash & 0x7f);
+
+	for(size_t step = 1; ; step += 1){
+		uint8_t const* group = m->ctrl + g * ARENA_MAP_GROUP;
+		uint32_t match = arena_map_group_match(group, h2);
+		while(match != 0){
+			size_t i = g * ARENA_MAP_GROUP + arena_map_lowest_bit(match);
+			if(arena_map_key_eq(m, m->slots + i * m->slot_size, key)){
+				return i;
+			}
+			match &= match - 1;
+		}
+		if(arena_map_group_match(group, ARENA_MAP_EMPTY) != 0){
+			return m->cap;
+		}
+		// Triangular probing visits every group when the count is a power of two
+		g = (g + step) & group_mask;
+	}
+}
+
+// Index of the first empty or deleted slot on hash's probe sequence
+static size_t
+arena_map_find_free(uint8_t const* ctrl, size_t cap, uint64_t hash){
+	size_t group_mask = cap / ARENA_MAP_GROUP - 1;
+	size_t g = (size_t)(hash >> 7) & group_mask;
+
+	for(size_t step = 1; ; step += 1){
+		uint32_t free_mask = arena_map_group_free(ctrl + g * ARENA_MAP_GROUP);
+		if(free_mask != 0){
+			return g * ARENA_MAP_GROUP + arena_map_lowest_bit(free_mask);
+		}
+		g = (g + step) & group_mask;
+	}
+}
+
+static bool
+arena_map_rehash(struct ArenaMap* m, size_t new_cap){
+	// Control bytes and slots share one allocation
+	size_t ctrl_size = align_forward_size(new_cap, m->slot_align);
+	if(new_cap > (SIZE_MAX - ctrl_size) / m->slot_size){ return false; }
+	byte* mem = arena_alloc_raw(m->arena, ctrl_size + new_cap * m->slot_size, m->slot_align);
+	if(mem == NULL){ return false; }
+
+	uint8_t* ctrl = mem;
+	byte* slots = mem + ctrl_size;
+	memset(ctrl, ARENA_MAP_EMPTY, new_cap);
+
+	for(size_t i = 0; i < m->cap; i += 1){
+		if(m->ctrl[i] & 0x80){ continue; }
+		byte const* slot = m->slots + i * m->slot_size;
+		uint64_t hash = arena_map_hash(m, slot);
+		size_t j = arena_map_find_free(ctrl, new_cap, hash);
+		ctrl[j] = m->ctrl[i];
+		memcpy(slots + j * m->slot_size, slot, m->slot_size);
+	}
+
+	m->ctrl = ctrl;
+	m->slots = slots;
+	m->cap = new_cap;
+	m->growth_left = new_cap - new_cap / 8 - m->len;
+	return true;
+}
+
+void*
+arena_map_get(struct ArenaMap const* m, void const* key){
+	size_t i = arena_map_find(m, key, arena_map_hash(m, key));
+	if(i == m->cap){ return NULL; }
+	return m->slots + i * m->slot_size + m->value_offset;
+}
+
+void*
+arena_map_put(struct ArenaMap* m, void const* key, bool* inserted){
+	uint64_t hash = arena_map_hash(m, key);
+	size_t i = arena_map_find(m, key, hash);
+	if(i < m->cap){
+		if(inserted != NULL){ *inserted = false; }
+		return m->slots + i * m->slot_size + m->value_offset;
+	}
+
+	if(m->growth_left == 0){
+		// Max load factor is 7/8. When tombstones are most of the load the
+		// table is rebuilt at the same size to get rid of them.
+		size_t new_cap = (m->cap > 0) ? m->cap : ARENA_MAP_GROUP;
+		if(m->len >= new_cap / 2){
+			new_cap *= 2;
+		}
+		if(!arena_map_rehash(m, new_cap)){ return NULL; }
+	}
+
+	i = arena_map_find_free(m->ctrl, m->cap, hash);
+	if(m->ctrl[i] == ARENA_MAP_EMPTY){
+		m->growth_left -= 1;
+	}
+	m->ctrl[i] = (uint8_t)(hash & 0x7f);
+	m->len += 1;
+
+	byte* slot = m->slots + i * m->slot_size;
+	memcpy(slot, key, m->key_size);
+	if(inserted != NULL){ *inserted = true; }
+	return slot + m->value_offset;
+}
+
+bool
+arena_map_remove(struct ArenaMap* m, void const* key){
+	size_t i = arena_map_find(m, key, arena_map_hash(m, key));
+	if(i == m->cap){ return false; }
+
+	m->ctrl[i] = ARENA_MAP_DELETED;
+	m->len -= 1;
+	return true;
+}
+
+#ifdef ARENA_CONCURRENT
+#define ARENA_CONCURRENT_BLOCK_HEADER_SIZE \
+	((sizeof(struct ArenaConcurrentBlock) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1))
+
+static struct ArenaConcurrentBlock*
+arena_concurrent_block_create(struct ArenaConcurrent* ar, size_t capacity){
+	if(capacity > SIZE_MAX - ARENA_CONCURRENT_BLOCK_HEADER_SIZE){ return NULL; }
+
+	byte* mem = ar->mem_alloc(ar->impl_data, ARENA_CONCURRENT_BLOCK_HEADER_SIZE + capacity);
+	if(mem == NULL){ return NULL; }
+
+	struct ArenaConcurrentBlock* blk = (struct ArenaConcurrentBlock*)mem;
+	blk->data = mem + ARENA_CONCURRENT_BLOCK_HEADER_SIZE;
+	blk->capacity = capacity;
+	blk->next = NULL;
+	atomic_init(&blk->offset, 0);
+
+	return blk;
+}
+
+bool
+arena_concurrent_init(struct ArenaConcurrent* ar, struct ArenaConfig const* cfg){
+	ar->mem_alloc = (cfg->mem_alloc != NULL) ? cfg->mem_alloc : arena_default_mem_alloc;
+	ar->mem_free = (cfg->mem_free != NULL) ? cfg->mem_free : arena_default_mem_free;
+	ar->impl_data = cfg->impl_data;
+	ar->growth = cfg->growth;
+	atomic_init(&ar->head, NULL);
+
+	if(cfg->capacity > 0){
+		struct ArenaConcurrentBlock* blk = arena_concurrent_block_create(ar, cfg->capacity);
+		if(blk == NULL){ return false; }
+		atomic_store(&ar->head, blk);
+	}
+	return true;
+}
+
+// Install a new head block after seen was found to be full. Another thread
+// may win the race, in which case our block is discarded and the caller
+// retries with theirs.
+static bool
+arena_concurrent_grow(struct ArenaConcurrent* ar, struct ArenaConcurrentBlock* seen, size_t size){
+	if(atomic_load_explicit(&ar->head, memory_order_acquire) != seen){
+		return true;
+	}
+
+	size_t last = (seen != NULL) ? seen->capacity : 0;
+	struct ArenaConcurrentBlock* blk = arena_concurrent_block_create(ar, arena_growth_capacity(&ar->growth, last, size));
+	if(blk == NULL){ return false; }
+
+	blk->next = seen;
+	if(!atomic_compare_exchange_strong_explicit(&ar->head, &seen, blk, memory_order_acq_rel, memory_order_acquire)){
+		ar->mem_free(ar->impl_data, blk);
+	}
+	return true;
+}
+
+void*
+arena_concurrent_alloc(struct ArenaConcurrent* ar, size_t nbytes, size_t alignment){
+	const size_t granule = alignof(max_align_t);
+	if(nbytes == 0){ return NULL; }
+
+	// Offsets stay multiples of granule, so only over aligned requests need
+	// room for padding. That has to be reserved up front as the offset we
+	// get is only known after the fetch_add.
+	size_t slack = (alignment > granule) ? (alignment - granule) : 0;
+	if(nbytes > SIZE_MAX / 4 || slack > SIZE_MAX / 4){ return NULL; }
+	size_t size = ((nbytes + granule - 1) & ~(granule - 1)) + slack;
+
+	for(;;){
+		struct ArenaConcurrentBlock* blk = atomic_load_explicit(&ar->head, memory_order_acquire);
+		if(blk != NULL){
+			size_t off = atomic_fetch_add_explicit(&blk->offset, size, memory_order_relaxed);
+			if(off <= blk->capacity && size <= blk->capacity - off){
+				return (void*)align_forward_ptr((uintptr_t)blk->data + off, alignment);
+			}
+		}
+		if(!arena_concurrent_grow(ar, blk, size)){ return NULL; }
+	}
+}
+
+void
+arena_concurrent_reset(struct ArenaConcurrent* ar){
+	struct ArenaConcurrentBlock* head = atomic_load(&ar->head);
+	if(head == NULL){ return; }
+
+	struct ArenaConcurrentBlock* cur = head->next;
+	while(cur != NULL){
+		struct ArenaConcurrentBlock* next = cur->next;
+		ar->mem_free(ar->impl_data, cur);
+		cur = next;
+	}
+	head->next = NULL;
+	atomic_store(&head->offset, 0);
+}
+
+void
+arena_concurrent_destroy(struct ArenaConcurrent* ar){
+	struct ArenaConcurrentBlock* cur = atomic_load(&ar->head);
+	while(cur != NULL){
+		struct ArenaConcurrentBlock* next = cur->next;
+		ar->mem_free(ar->impl_data, cur);
+		cur = next;
+	}
+	atomic_store(&ar->head, NULL);
+}
+
+void*
+arena_concurrent_mem_alloc(void* impl_data, size_t n){
+	return arena_concurrent_alloc(impl_data, n, alignof(max_align_t));
+}
+
+void
+arena_concurrent_mem_free(void* impl_data, void* p){
+	(void)impl_data;
+	(void)p;
+}
+
+struct ArenaAllocator
+arena_tlab_create(struct ArenaConcurrent* parent, size_t chunk){
+	struct ArenaConfig cfg = {
+		.mem_alloc = arena_concurrent_mem_alloc,
+		.mem_free = arena_concurrent_mem_free,
+		.impl_data = parent,
+		.capacity = chunk,
+		.growth = { .kind = ARENA_GROWTH_FIXED, .size = chunk },
+	};
+	return arena_create_ex(&cfg);
+}
+
+size_t
+arena_concurrent_block_count(struct ArenaConcurrent* ar){
+	struct ArenaConcurrentBlock* blk = atomic_load(&ar->head);
 	size_t total = 0;
 
 	while(blk != NULL){
-		total += blk->capacity;
+		total += 1;
 		blk = blk->next;
 	}
 
 	return total;
 }
+#endif /* ARENA_CONCURRENT */
 
 #undef byte
 
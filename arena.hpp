@@ -0,0 +1,309 @@
+/* See arena.h for LICENSE information */
+
+/// Arena.hpp
+// C++ helpers on top of arena.h. The implementation still lives in arena.h and
+// must be compiled **once** as C with ARENA_IMPLEMENTATION defined.
+
+#ifndef _arena_hpp_included_
+#define _arena_hpp_included_
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <memory_resource>
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+
+#include "arena.h"
+
+/// Containers /////////////////////////////////////////////////////////////////
+
+// Dynamic array allocated from an arena, C++ version of ArenaArray(T). Grows in
+// place while it is the most recent allocation of the arena. Elements are
+// moved around with memcpy and never destroyed, so T must be trivially
+// copyable. Memory is only given back with the arena.
+template<typename T>
+struct ArenaVector {
+	static_assert(std::is_trivially_copyable<T>::value, "ArenaVector<T> needs a trivially copyable T");
+
+	T* data_ = nullptr;
+	size_t len_ = 0;
+	size_t cap_ = 0;
+	ArenaAllocator* arena_ = nullptr;
+
+	ArenaVector() = default;
+	explicit ArenaVector(ArenaAllocator* ar) : arena_(ar) {}
+
+	// Make room for n more elements. Returns false on failure.
+	bool reserve(size_t n){
+		if(cap_ - len_ >= n){ return true; }
+		data_ = static_cast<T*>(arena_array_grow(arena_, data_, len_, &cap_, n, sizeof(T), alignof(T)));
+		return cap_ - len_ >= n;
+	}
+
+	// Append one element. Returns false on failure.
+	bool push(T const& v){
+		if(!reserve(1)){ return false; }
+		data_[len_++] = v;
+		return true;
+	}
+
+	// Append n elements copied from src. Returns false on failure.
+	bool push_n(T const* src, size_t n){
+		if(!reserve(n)){ return false; }
+		std::memcpy(static_cast<void*>(data_ + len_), src, sizeof(T) * n);
+		len_ += n;
+		return true;
+	}
+
+	T pop(){ return data_[--len_]; }
+	void clear(){ len_ = 0; }
+
+	T& operator[](size_t i){ return data_[i]; }
+	T const& operator[](size_t i) const { return data_[i]; }
+
+	T* data(){ return data_; }
+	T const* data() const { return data_; }
+	size_t size() const { return len_; }
+	size_t capacity() const { return cap_; }
+	bool empty() const { return len_ == 0; }
+
+	T* begin(){ return data_; }
+	T* end(){ return data_ + len_; }
+	T const* begin() const { return data_; }
+	T const* end() const { return data_ + len_; }
+};
+
+/// Objects //////////////////////////////////////////////////////////////////
+
+// Typed allocation with size and alignment known at compile time, so the fast
+// path folds to an add and a mask. Align can raise the alignment of T and must
+// be a power of two. Returns nullptr on failure or if n T's overflow size_t.
+template<typename T, size_t Align = alignof(T)>
+T* arena_alloc_as(ArenaAllocator* ar, size_t n = 1) noexcept {
+	static_assert(Align != 0 && (Align & (Align - 1)) == 0, "Align must be a power of two");
+	constexpr size_t align = (Align > alignof(T)) ? Align : alignof(T);
+	if(n > SIZE_MAX / sizeof(T)){ return nullptr; }
+	return static_cast<T*>(arena_alloc_raw(ar, sizeof(T) * n, align));
+}
+
+template<typename T>
+void arena_finalize_object(void* obj){
+	static_cast<T*>(obj)->~T();
+}
+
+// Constructs a T in the arena. Its destructor runs on arena_reset(),
+// arena_destroy() or when rewinding past it, and is only registered when T is
+// not trivially destructible. Returns nullptr if the arena is out of memory,
+// exceptions from the constructor are passed on.
+template<typename T, typename... Args>
+T* arena_make(ArenaAllocator* ar, Args&&... args){
+	void* mem = arena_alloc_raw(ar, sizeof(T), alignof(T));
+	if(mem == nullptr){ return nullptr; }
+	T* obj = ::new(mem) T(std::forward<Args>(args)...);
+
+	if constexpr(!std::is_trivially_destructible<T>::value){
+		if(!arena_add_finalizer(ar, arena_finalize_object<T>, obj)){
+			obj->~T();
+			return nullptr;
+		}
+	}
+	return obj;
+}
+
+// C++ version of the arena_alloc_soa() macro, points every column at n elements
+// allocated with a single bump. Each column is aligned to at least align.
+template<typename... Ts>
+bool arena_alloc_soa(ArenaAllocator* ar, size_t n, size_t align, Ts*&... cols){
+	ArenaColumn columns[] = { { reinterpret_cast<void**>(&cols), sizeof(Ts), alignof(Ts) }... };
+	return arena_alloc_columns(ar, n, align, columns, sizeof...(Ts));
+}
+
+/// Arena class ////////////////////////////////////////////////////////////////
+
+#if defined(__cpp_lib_span)
+template<typename T>
+using ArenaSpan = std::span<T>;
+#else
+// Minimal stand in for std::span before C++20
+template<typename T>
+struct ArenaSpan {
+	T* data_ = nullptr;
+	size_t size_ = 0;
+
+	constexpr ArenaSpan() = default;
+	constexpr ArenaSpan(T* data, size_t size) : data_(data), size_(size) {}
+
+	constexpr T* data() const { return data_; }
+	constexpr size_t size() const { return size_; }
+	constexpr size_t size_bytes() const { return size_ * sizeof(T); }
+	constexpr bool empty() const { return size_ == 0; }
+	constexpr T& operator[](size_t i) const { return data_[i]; }
+	constexpr T* begin() const { return data_; }
+	constexpr T* end() const { return data_ + size_; }
+};
+#endif
+
+// Owning, move only handle to an ArenaAllocator, destroys it when it goes out
+// of scope. Everything forwards to the inline C fast path with sizes and
+// alignments known at compile time. Moving an Arena moves the ArenaAllocator
+// too, so pointers to the old get() must not be used after a move.
+class Arena {
+public:
+	explicit Arena(size_t capacity = ARENA_GROW_MIN_BLOCK) noexcept
+		: ar_(arena_create(nullptr, nullptr, capacity)) {}
+	explicit Arena(ArenaConfig const& cfg) noexcept : ar_(arena_create_ex(&cfg)) {}
+	explicit Arena(ArenaAllocator ar) noexcept : ar_(ar) {}
+
+	Arena(Arena const&) = delete;
+	Arena& operator=(Arena const&) = delete;
+
+	Arena(Arena&& other) noexcept : ar_(other.ar_) {
+		other.ar_ = ArenaAllocator{};
+	}
+
+	Arena& operator=(Arena&& other) noexcept {
+		if(this != &other){
+			arena_destroy(&ar_);
+			ar_ = other.ar_;
+			other.ar_ = ArenaAllocator{};
+		}
+		return *this;
+	}
+
+	~Arena(){ arena_destroy(&ar_); }
+
+	ArenaAllocator* get() noexcept { return &ar_; }
+	ArenaAllocator const* get() const noexcept { return &ar_; }
+
+	// Uninitialized storage for n T's, an empty span on failure. See
+	// arena_alloc_as() for Align.
+	template<typename T, size_t Align = alignof(T)>
+	ArenaSpan<T> alloc(size_t n = 1) noexcept {
+		T* p = arena_alloc_as<T, Align>(&ar_, n);
+		if(p == nullptr){ return ArenaSpan<T>(); }
+		return ArenaSpan<T>(p, n);
+	}
+
+	// See arena_make()
+	template<typename T, typename... Args>
+	T* make(Args&&... args){
+		return arena_make<T>(&ar_, std::forward<Args>(args)...);
+	}
+
+	void reset() noexcept { arena_reset(&ar_); }
+	ArenaMark mark() const noexcept { return arena_mark(&ar_); }
+	void rewind(ArenaMark m) noexcept { arena_rewind(&ar_, m); }
+
+	// Rewinds the arena to where it was when the scope was created
+	class Scope {
+	public:
+		explicit Scope(Arena& arena) noexcept : ar_(arena.get()), mark_(arena_mark(ar_)) {}
+		explicit Scope(ArenaAllocator* ar) noexcept : ar_(ar), mark_(arena_mark(ar)) {}
+
+		Scope(Scope const&) = delete;
+		Scope& operator=(Scope const&) = delete;
+
+		~Scope(){ arena_rewind(ar_, mark_); }
+
+	private:
+		ArenaAllocator* ar_;
+		ArenaMark mark_;
+	};
+
+private:
+	ArenaAllocator ar_;
+};
+
+/// Standard library adapters ////////////////////////////////////////////////
+
+// std::pmr::memory_resource over an arena, for the std::pmr containers.
+// Deallocating only gives memory back if it is the most recent allocation,
+// otherwise it is a no-op. Throws std::bad_alloc when the arena can't grow, as
+// memory_resource requires.
+class arena_resource : public std::pmr::memory_resource {
+public:
+	explicit arena_resource(ArenaAllocator* ar) noexcept : arena_(ar) {}
+
+	ArenaAllocator* arena() const noexcept { return arena_; }
+
+protected:
+	void* do_allocate(size_t bytes, size_t alignment) override {
+		void* p = arena_alloc_raw(arena_, bytes, alignment);
+		if(p == nullptr){ return allocate_failed(bytes, alignment); }
+		return p;
+	}
+
+	void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+		(void)alignment;
+		arena_shrink(arena_, p, bytes, 0);
+	}
+
+	bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+		auto o = dynamic_cast<arena_resource const*>(&other);
+		return o != nullptr && o->arena_ == arena_;
+	}
+
+private:
+	// Kept out of do_allocate() so the bump path stays small. Zero byte
+	// requests still get a unique pointer.
+	[[gnu::noinline, gnu::cold]] void* allocate_failed(size_t bytes, size_t alignment){
+		void* p = (bytes == 0) ? arena_alloc_raw(arena_, 1, alignment) : nullptr;
+		if(p == nullptr){ throw std::bad_alloc(); }
+		return p;
+	}
+
+	ArenaAllocator* arena_;
+};
+
+// Stateful allocator over an arena for the standard containers, for code that
+// can't use std::pmr. Like std::pmr::polymorphic_allocator a container keeps
+// its arena on copy and move assignment, the elements are copied into it, so
+// assigning from a container on a shorter lived arena can't leave it dangling.
+// Copy construction shares the source's arena and swap exchanges them. Two
+// allocators are equal when they share an arena. allocate() is the inline bump
+// path, deallocate() only gives back the most recent allocation.
+template<typename T>
+struct ArenaStlAllocator {
+	using value_type = T;
+	using propagate_on_container_copy_assignment = std::false_type;
+	using propagate_on_container_move_assignment = std::false_type;
+	using propagate_on_container_swap = std::true_type;
+	using is_always_equal = std::false_type;
+
+	template<typename U>
+	struct rebind { using other = ArenaStlAllocator<U>; };
+
+	ArenaAllocator* arena_;
+
+	explicit ArenaStlAllocator(ArenaAllocator* ar) noexcept : arena_(ar) {}
+
+	template<typename U>
+	ArenaStlAllocator(ArenaStlAllocator<U> const& other) noexcept : arena_(other.arena_) {}
+
+	T* allocate(size_t n){
+		if(n > SIZE_MAX / sizeof(T)){ throw std::bad_array_new_length(); }
+		void* p = arena_alloc_raw(arena_, (n > 0) ? sizeof(T) * n : 1, alignof(T));
+		if(p == nullptr){ throw std::bad_alloc(); }
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, size_t n) noexcept {
+		arena_shrink(arena_, p, sizeof(T) * n, 0);
+	}
+};
+
+template<typename T, typename U>
+bool operator==(ArenaStlAllocator<T> const& a, ArenaStlAllocator<U> const& b) noexcept {
+	return a.arena_ == b.arena_;
+}
+
+template<typename T, typename U>
+bool operator!=(ArenaStlAllocator<T> const& a, ArenaStlAllocator<U> const& b) noexcept {
+	return a.arena_ != b.arena_;
+}
+
+#endif /* Include guard */
@@ -0,0 +1,170 @@
+// Benchmarks for the C++ adapters, build with `./build.sh bench`
+#include "arena.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <vector>
+#include <unordered_map>
+#include <map>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+static volatile uintptr_t bench_sink;
+
+// Runs fn rounds times with reset() in between, prints nanoseconds per op
+template<typename Fn, typename Reset>
+static void bench(char const* name, size_t ops, int rounds, Fn fn, Reset reset){
+	double best = 1e30;
+	for(int r = 0; r < rounds; r += 1){
+		auto start = Clock::now();
+		fn();
+		auto end = Clock::now();
+		reset();
+		double ns = std::chrono::duration<double, std::nano>(end - start).count() / double(ops);
+		if(ns < best){ best = ns; }
+	}
+	std::printf("  %-40s %8.2f ns/op\n", name, best);
+}
+
+// A memory resource under test and how to give its memory back between rounds
+struct BenchResource {
+	char const* name;
+	std::pmr::memory_resource* res;
+	std::function<void()> reset;
+};
+
+// Runs fn on every resource, taking turns each round so none of them gets the
+// caches and malloc state another one left behind. Prints the best ns per op.
+template<typename Fn>
+static void bench_resources(char const* name, size_t ops, std::vector<BenchResource> const& rs, Fn fn){
+	const int rounds = 20;
+	std::vector<double> best(rs.size(), 1e30);
+	for(int r = 0; r < rounds; r += 1){
+		for(size_t i = 0; i < rs.size(); i += 1){
+			auto start = Clock::now();
+			fn(rs[i].res);
+			auto end = Clock::now();
+			rs[i].reset();
+			double ns = std::chrono::duration<double, std::nano>(end - start).count() / double(ops);
+			if(ns < best[i]){ best[i] = ns; }
+		}
+	}
+	std::printf("  %s\n", name);
+	for(size_t i = 0; i < rs.size(); i += 1){
+		std::printf("    %-38s %8.2f ns/op\n", rs[i].name, best[i]);
+	}
+}
+
+static void bench_pmr(std::vector<BenchResource> const& rs){
+	std::printf("[std::pmr]\n");
+
+	const size_t small_allocs = 1000000;
+	bench_resources("allocate 24 bytes", small_allocs, rs, [&](std::pmr::memory_resource* mr){
+		for(size_t i = 0; i < small_allocs; i += 1){
+			bench_sink = (uintptr_t)mr->allocate(24, 8);
+		}
+	});
+
+	const size_t pushes = 1000000;
+	bench_resources("pmr::vector<int> push_back", pushes, rs, [&](std::pmr::memory_resource* mr){
+		std::pmr::vector<int> v(mr);
+		for(size_t i = 0; i < pushes; i += 1){ v.push_back(int(i)); }
+		bench_sink = (uintptr_t)v.data();
+	});
+
+	const size_t inserts = 200000;
+	bench_resources("pmr::unordered_map<int, int> insert", inserts, rs, [&](std::pmr::memory_resource* mr){
+		std::pmr::unordered_map<int, int> m(mr);
+		for(size_t i = 0; i < inserts; i += 1){ m.emplace(int(i), int(i)); }
+		bench_sink = m.size();
+	});
+}
+
+// std::map node allocations with and without ArenaStlAllocator
+static void bench_stl_allocator(){
+	std::printf("[ArenaStlAllocator]\n");
+	const size_t inserts = 200000;
+	const int rounds = 10;
+
+	ArenaAllocator ar = arena_create(0, 0, 1024 * 1024);
+	bench("std::map<int, int> insert (arena)", inserts, rounds, [&]{
+		using Alloc = ArenaStlAllocator<std::pair<int const, int>>;
+		std::map<int, int, std::less<int>, Alloc> m{Alloc(&ar)};
+		for(size_t i = 0; i < inserts; i += 1){ m.emplace(int(i), int(i)); }
+		bench_sink = m.size();
+	}, [&]{ arena_reset(&ar); });
+	arena_destroy(&ar);
+
+	bench("std::map<int, int> insert (malloc)", inserts, rounds, [&]{
+		std::map<int, int> m;
+		for(size_t i = 0; i < inserts; i += 1){ m.emplace(int(i), int(i)); }
+		bench_sink = m.size();
+	}, []{});
+}
+
+// The fast path as it was with a division for the alignment, to compare
+static inline void* alloc_raw_modulo(ArenaAllocator* ar, size_t nbytes, size_t alignment){
+	uintptr_t aligned = ar->cursor;
+	uintptr_t mod = aligned % alignment;
+	if(mod > 0){ aligned += alignment - mod; }
+	uintptr_t next = aligned + nbytes;
+	if(next > aligned && next <= ar->end){
+		ar->cursor = next;
+		return (void*)aligned;
+	}
+	return arena_alloc_slow(ar, nbytes, alignment);
+}
+
+// Cycles per allocation of the bump path, with the alignment only known at run
+// time (as from std::pmr) and as a compile time constant
+static void bench_alignment(){
+#ifdef BENCH_HAVE_TSC
+	std::printf("[alignment]\n");
+	const size_t allocs = 1000000;
+	const int rounds = 20;
+	static volatile size_t runtime_align = 8;
+
+	ArenaAllocator ar = arena_create(0, 0, 32 * 1024 * 1024);
+	auto run = [&](char const* name, auto alloc){
+		uint64_t best = UINT64_MAX;
+		for(int r = 0; r < rounds; r += 1){
+			arena_reset(&ar);
+			uint64_t start = __rdtsc();
+			for(size_t i = 0; i < allocs; i += 1){
+				bench_sink = (uintptr_t)alloc(16 + (i & 8));
+			}
+			uint64_t cycles = __rdtsc() - start;
+			if(cycles < best){ best = cycles; }
+		}
+		std::printf("  %-40s %8.2f cycles/alloc\n", name, double(best) / double(allocs));
+	};
+
+	size_t align = runtime_align;
+	run("runtime alignment, modulo", [&](size_t n){ return alloc_raw_modulo(&ar, n, align); });
+	run("runtime alignment, mask", [&](size_t n){ return arena_alloc_raw(&ar, n, align); });
+	run("constant alignment", [&](size_t n){ return arena_alloc_raw(&ar, n, 8); });
+	arena_destroy(&ar);
+#endif
+}
+
+int main(){
+	{
+		ArenaAllocator ar = arena_create(0, 0, 1024 * 1024);
+		arena_resource arena_res(&ar);
+		std::pmr::monotonic_buffer_resource mono_res(1024 * 1024);
+		bench_pmr({
+			{ "arena_resource", &arena_res, [&]{ arena_reset(&ar); } },
+			{ "monotonic_buffer_resource", &mono_res, [&]{ mono_res.release(); } },
+		});
+		arena_destroy(&ar);
+	}
+	bench_stl_allocator();
+	bench_alignment();
+	return 0;
+}
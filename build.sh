@@ -2,8 +2,20 @@
 
 CC=gcc
 CFLAGS='-O2 -pipe'
+CXX=g++
+CXXFLAGS='-O2 -pipe -std=c++17'
 
 set -xe
 
-$CC $CFLAGS test.c -o test.bin
+$CC $CFLAGS -pthread test.c -o test.bin
 ./test.bin
+
+# The implementation is C, build it once for the C++ side
+$CC $CFLAGS -x c -DARENA_IMPLEMENTATION -c arena.h -o arena.o
+$CXX $CXXFLAGS test.cpp arena.o -o test_cpp.bin
+./test_cpp.bin
+
+if [ "$1" = "bench" ]; then
+	$CXX $CXXFLAGS bench.cpp arena.o -o bench.bin
+	./bench.bin
+fi
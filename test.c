@@ -8,6 +8,7 @@ int test_arena(){
 	Test_Begin("Arena Allocator");
 	{   // Single node
 		struct ArenaAllocator ar = arena_create(0, 0, 200);
+		Tp(arena_total_capacity(&ar) == 200);
 		// Test_Log("Blocks: %zu Total capacity: %zu", arena_block_count(&ar), arena_total_capacity(&ar));
 		int n = 40;
 		int* numbers = arena_alloc(&ar, int, n + 9);
@@ -43,7 +44,1053 @@ int test_arena(){
 	Test_End();
 }
 
+// Allocates n chunks of size bytes, returns false if any allocation failed
+static bool fill_arena(struct ArenaAllocator* ar, size_t n, size_t size){
+	for(size_t i = 0; i < n; i += 1){
+		if(arena_alloc_raw(ar, size, 8) == NULL){ return false; }
+	}
+	return true;
+}
+
+int test_growth(){
+	Test_Begin("Growth Policies");
+	const size_t n = 4000, size = 24;
+	{   // Doubling, block count is logarithmic until the limit is hit
+		struct ArenaConfig cfg = { .capacity = 64, .growth = { .kind = ARENA_GROWTH_DOUBLE, .size = 1 << 20 } };
+		struct ArenaAllocator ar = arena_create_ex(&cfg);
+		Tp(fill_arena(&ar, n, size));
+		// 64 * 2^11 > n * size, plus one for slack
+		Tp(arena_block_count(&ar) <= 12);
+		Tp(ar.head->capacity <= (1 << 20));
+		arena_destroy(&ar);
+	}
+	{   // Doubling with a small limit degrades to fixed size blocks
+		struct ArenaConfig cfg = { .capacity = 64, .growth = { .kind = ARENA_GROWTH_DOUBLE, .size = 1024 } };
+		struct ArenaAllocator ar = arena_create_ex(&cfg);
+		Tp(fill_arena(&ar, n, size));
+		Tp(arena_block_count(&ar) <= 5 + (n * size) / (1024 - size));
+		Tp(ar.head->capacity == 1024);
+		arena_destroy(&ar);
+	}
+	{   // Fixed chunks
+		struct ArenaConfig cfg = { .capacity = 64, .growth = { .kind = ARENA_GROWTH_FIXED, .size = 4096 } };
+		struct ArenaAllocator ar = arena_create_ex(&cfg);
+		Tp(fill_arena(&ar, n, size));
+		Tp(arena_block_count(&ar) <= 2 + (n * size) / (4096 - size));
+		Tp(arena_alloc_raw(&ar, 10000, 8) != NULL);
+		Tp(ar.head->capacity >= 10000);
+		arena_destroy(&ar);
+	}
+	{   // Geometric, requests just over the block size don't make tiny blocks
+		struct ArenaConfig cfg = { .capacity = 64, .growth = { .kind = ARENA_GROWTH_GEOMETRIC, .factor = 1.25, .k = 2 } };
+		struct ArenaAllocator ar = arena_create_ex(&cfg);
+		Tp(fill_arena(&ar, n, size));
+		Tp(arena_block_count(&ar) <= 12);
+		arena_destroy(&ar);
+	}
+	{   // Tails of older blocks get used, full blocks leave the open list
+		struct ArenaConfig cfg = { .capacity = 1024, .growth = { .kind = ARENA_GROWTH_FIXED, .size = 1024 } };
+		struct ArenaAllocator ar = arena_create_ex(&cfg);
+		Tp(arena_alloc_raw(&ar, 900, 8) != NULL);
+		Tp(arena_alloc_raw(&ar, 200, 8) != NULL);
+		Tp(arena_alloc_raw(&ar, 800, 8) != NULL);
+		Tp(ar.open != NULL);
+		Tp(arena_alloc_raw(&ar, 100, 8) != NULL);
+		Tp(arena_block_count(&ar) == 2);
+		Tp(ar.open == NULL);
+
+		// A reset keeps the other block as a spare, taking it makes it the head
+		arena_reset(&ar);
+		Tp(ar.open == NULL && ar.spare != NULL && ar.spare->next == NULL);
+		struct ArenaBlock* spare = ar.spare;
+		Tp(arena_alloc_raw(&ar, 1000, 8) != NULL && arena_alloc_raw(&ar, 1000, 8) != NULL);
+		Tp(ar.head == spare && ar.spare == NULL && arena_block_count(&ar) == 2);
+		arena_destroy(&ar);
+	}
+	{   // No initial block
+		struct ArenaConfig cfg = {0};
+		struct ArenaAllocator ar = arena_create_ex(&cfg);
+		Tp(arena_block_count(&ar) == 0);
+		Tp(fill_arena(&ar, 10, size));
+		Tp(arena_block_count(&ar) == 1);
+		arena_reset(&ar);
+		arena_destroy(&ar);
+	}
+	Test_End();
+}
+
+int test_virtual(){
+	Test_Begin("Virtual Memory Arena");
+#ifdef ARENA_VIRTUAL_MEMORY
+	{
+		struct ArenaAllocator ar = arena_create_virtual(64 * 1024 * 1024, 0);
+		Tp(ar.vm_base != NULL);
+		Tp(arena_total_capacity(&ar) == 0);
+
+		char* a = arena_alloc(&ar, char, 100);
+		char* b = arena_alloc(&ar, char, 3 * ARENA_VM_COMMIT_GRANULE);
+		Tp(a != NULL && b == a + 100);
+		b[3 * ARENA_VM_COMMIT_GRANULE - 1] = 1;
+		Tp(arena_total_capacity(&ar) == 4 * ARENA_VM_COMMIT_GRANULE);
+		Tp(arena_block_count(&ar) == 0);
+
+		Tp(arena_alloc_raw(&ar, 128 * 1024 * 1024, 1) == NULL);
+
+		arena_reset(&ar);
+		Tp(arena_alloc(&ar, char, 100) == a);
+
+		arena_reset_decommit(&ar);
+		Tp(arena_total_capacity(&ar) == 0);
+		int* n = arena_alloc(&ar, int, 1);
+		Tp(n != NULL && *n == 0);
+		arena_destroy(&ar);
+	}
+	{
+		// Reserving nothing fails like any other failed reservation
+		struct ArenaAllocator ar = arena_create_virtual(0, 0);
+		Tp(ar.vm_base == NULL);
+		Tp(arena_alloc(&ar, char, 1) == NULL && !arena_push_block(&ar, 4096));
+		Tp(arena_block_count(&ar) == 0 && arena_total_capacity(&ar) == 0);
+		arena_reset(&ar);
+		arena_destroy(&ar);
+	}
+#endif
+	Test_End();
+}
+
+int test_huge_pages(){
+	Test_Begin("Huge Page Blocks");
+#ifdef ARENA_HUGE_PAGES
+	{
+		struct ArenaHugePages hp = { .use_hugetlb = true };
+		struct ArenaConfig cfg = {
+			.mem_alloc = arena_hugepage_mem_alloc,
+			.mem_free = arena_hugepage_mem_free,
+			.impl_data = &hp,
+			.capacity = arena_hugepage_capacity(1),
+		};
+		struct ArenaAllocator ar = arena_create_ex(&cfg);
+		Tp(ar.head != NULL);
+		Tp(((uintptr_t)ar.head % ARENA_HUGE_PAGE_SIZE) <= alignof(max_align_t));
+
+		// The whole capacity fits one huge page
+		size_t mapped = hp.hugetlb_bytes + hp.advised_bytes + hp.fallback_bytes;
+		Tp(mapped == ARENA_HUGE_PAGE_SIZE);
+		// Test_Log("hugetlb: %zu advised: %zu fallback: %zu", hp.hugetlb_bytes, hp.advised_bytes, hp.fallback_bytes);
+
+		char* p = arena_alloc(&ar, char, cfg.capacity);
+		Tp(p != NULL && arena_block_count(&ar) == 1);
+		p[0] = 1; p[cfg.capacity - 1] = 1;
+
+		// Advising is only a request, what backs the pages is up to the kernel
+		size_t thp = arena_hugepage_thp_bytes(p);
+		Tp(thp % ARENA_HUGE_PAGE_SIZE == 0);
+		Tp(hp.advised_bytes > 0 || thp == 0);
+
+		arena_destroy(&ar);
+		Tp(hp.hugetlb_bytes + hp.advised_bytes + hp.fallback_bytes == 0);
+	}
+#endif
+	Test_End();
+}
+
+static void scoped_alloc(struct ArenaAllocator* ar){
+	arena_scope(ar);
+	(void)arena_alloc(ar, char, 100000);
+}
+
+int test_mark(){
+	Test_Begin("Mark and Rewind");
+	{
+		struct ArenaAllocator ar = arena_create(0, 0, 256);
+		int* keep = arena_alloc(&ar, int, 4);
+		struct ArenaMark mark = arena_mark(&ar);
+
+		bool ok = true;
+		for(int i = 0; i < 100; i += 1){
+			ok = ok && (arena_alloc(&ar, char, 200) != NULL);
+		}
+		Tp(ok);
+		Tp(arena_block_count(&ar) > 1);
+
+		arena_rewind(&ar, mark);
+		Tp(arena_block_count(&ar) == 1);
+		Tp(ar.open == NULL);
+		Tp(arena_alloc(&ar, int, 4) == keep + 4);
+
+		// Nested
+		struct ArenaMark outer = arena_mark(&ar);
+		arena_alloc(&ar, char, 1000);
+		struct ArenaMark inner = arena_mark(&ar);
+		arena_alloc(&ar, char, 100000);
+		Tp(arena_block_count(&ar) == 3);
+		arena_rewind(&ar, inner);
+		Tp(arena_block_count(&ar) == 2);
+		arena_rewind(&ar, outer);
+		Tp(arena_block_count(&ar) == 1);
+		Tp(ar.cursor == outer.cursor);
+
+#ifdef arena_scope
+		struct ArenaMark before = arena_mark(&ar);
+		scoped_alloc(&ar);
+		Tp(ar.cursor == before.cursor && arena_block_count(&ar) == 1);
+#endif
+		arena_destroy(&ar);
+	}
+	{
+		// Rewinding within the head leaves the open list alone
+		struct ArenaConfig cfg = { .capacity = 512, .growth = { .kind = ARENA_GROWTH_FIXED, .size = 512 } };
+		struct ArenaAllocator ar = arena_create_ex(&cfg);
+		fill_arena(&ar, 20, 300);
+		struct ArenaBlock* open = ar.open;
+		Tp(open != NULL);
+
+		struct ArenaMark mark = arena_mark(&ar);
+		arena_alloc(&ar, char, 16);
+		arena_rewind(&ar, mark);
+		Tp(ar.cursor == mark.cursor && ar.open == open);
+
+		// Pushing a block demotes the marked one, rewinding brings it back
+		arena_alloc(&ar, char, 100);
+		mark = arena_mark(&ar);
+		struct ArenaBlock* head = ar.head;
+		arena_push_block(&ar, 256);
+		Tp(ar.open == head);
+		arena_rewind(&ar, mark);
+		Tp(ar.head == head && ar.open == open && ar.cursor == mark.cursor);
+
+		arena_destroy(&ar);
+	}
+	{
+		// Spare blocks kept by a reset go back to the spares on rewind
+		struct ArenaConfig cfg = { .capacity = 1024, .growth = { .kind = ARENA_GROWTH_FIXED, .size = 1024 } };
+		struct ArenaAllocator ar = arena_create_ex(&cfg);
+		fill_arena(&ar, 4, 1000);
+		arena_reset(&ar);
+		struct ArenaMark mark = arena_mark(&ar);
+		fill_arena(&ar, 3, 1000);
+		Tp(arena_block_count(&ar) == 4 && ar.spare != NULL && ar.spare->next == NULL);
+		arena_rewind(&ar, mark);
+		Tp(arena_block_count(&ar) == 4 && ar.cursor == mark.cursor);
+		Tp(ar.head->next == NULL && ar.open == NULL);
+		arena_destroy(&ar);
+	}
+	Test_End();
+}
+
+int test_scratch(){
+	Test_Begin("Scratch Arenas");
+	{
+		struct ArenaScope a = arena_scratch();
+		Tp(a.arena != NULL);
+		char* p = arena_alloc(a.arena, char, 100);
+		Tp(p != NULL);
+
+		struct ArenaScope b = arena_scratch(a.arena);
+		Tp(b.arena != NULL && b.arena != a.arena);
+
+		struct ArenaScope c = arena_scratch(a.arena, b.arena);
+		Tp(c.arena == NULL);
+		arena_scratch_end(c);
+
+		arena_alloc(b.arena, char, 1000);
+		arena_scratch_end(b);
+		Tp(b.arena->cursor == b.mark.cursor);
+
+		arena_scratch_end(a);
+		Tp(arena_alloc(a.arena, char, 100) == p);
+		arena_scratch_release();
+	}
+	Test_End();
+}
+
+#if defined(ARENA_CONCURRENT) && defined(__unix__)
+#include <pthread.h>
+
+#define CONCURRENT_THREADS 4
+#define CONCURRENT_ALLOCS 20000
+
+struct ConcurrentWork {
+	struct ArenaConcurrent* arena;
+	unsigned char id;
+	unsigned char* ptrs[CONCURRENT_ALLOCS];
+};
+
+static void* concurrent_worker(void* data){
+	struct ConcurrentWork* w = data;
+	for(int i = 0; i < CONCURRENT_ALLOCS; i += 1){
+		unsigned char* p = arena_concurrent_alloc(w->arena, 24, 8);
+		if(p != NULL){
+			for(int j = 0; j < 24; j += 1){ p[j] = w->id; }
+		}
+		w->ptrs[i] = p;
+	}
+	return NULL;
+}
+#endif
+
+int test_concurrent(){
+	Test_Begin("Concurrent Arena");
+#if defined(ARENA_CONCURRENT) && defined(__unix__)
+	{
+		struct ArenaConcurrent ar;
+		struct ArenaConfig cfg = { .capacity = 4096 };
+		Tp(arena_concurrent_init(&ar, &cfg));
+
+		static struct ConcurrentWork work[CONCURRENT_THREADS];
+		pthread_t threads[CONCURRENT_THREADS];
+		for(int i = 0; i < CONCURRENT_THREADS; i += 1){
+			work[i].arena = &ar;
+			work[i].id = (unsigned char)(i + 1);
+			pthread_create(&threads[i], NULL, concurrent_worker, &work[i]);
+		}
+		for(int i = 0; i < CONCURRENT_THREADS; i += 1){
+			pthread_join(threads[i], NULL);
+		}
+
+		// Nobody stepped on anybody else's allocation
+		bool ok = true;
+		for(int i = 0; i < CONCURRENT_THREADS; i += 1){
+			for(int n = 0; n < CONCURRENT_ALLOCS; n += 1){
+				unsigned char* p = work[i].ptrs[n];
+				ok = ok && (p != NULL) && ((uintptr_t)p % 8 == 0);
+				for(int j = 0; ok && j < 24; j += 1){ ok = (p[j] == work[i].id); }
+			}
+		}
+		Tp(ok);
+
+		void* big = arena_concurrent_alloc(&ar, 100, 256);
+		Tp(big != NULL && (uintptr_t)big % 256 == 0);
+
+		// Thread local buffers carved from the shared arena
+		struct ArenaAllocator tlab = arena_tlab_create(&ar, 1024);
+		size_t parent_blocks = arena_concurrent_block_count(&ar);
+		ok = true;
+		for(int n = 0; n < 1000; n += 1){
+			ok = ok && (arena_alloc(&tlab, int, 4) != NULL);
+		}
+		Tp(ok);
+		Tp(arena_block_count(&tlab) >= 16 && arena_block_count(&tlab) <= 17);
+		Tp(arena_concurrent_block_count(&ar) <= parent_blocks + 1);
+
+		arena_concurrent_reset(&ar);
+		Tp(arena_concurrent_block_count(&ar) == 1);
+		arena_concurrent_destroy(&ar);
+		Tp(arena_concurrent_block_count(&ar) == 0);
+	}
+#endif
+	Test_End();
+}
+
+static size_t counted_allocs = 0;
+
+static void* counting_mem_alloc(void* impl_data, size_t n){
+	(void)impl_data;
+	counted_allocs += 1;
+	return malloc(n);
+}
+
+int test_block_pool(){
+	Test_Begin("Block Pool");
+	{
+		struct ArenaBlockPool pool;
+		arena_block_pool_init(&pool, counting_mem_alloc, NULL, NULL, 1024 * 1024);
+
+		size_t allocs_after_first = 0;
+		for(int i = 0; i < 10; i += 1){
+			struct ArenaConfig cfg = { .capacity = 1000, .pool = &pool };
+			struct ArenaAllocator ar = arena_create_ex(&cfg);
+			for(int n = 0; n < 100; n += 1){
+				arena_alloc(&ar, char, 300);
+			}
+			arena_destroy(&ar);
+			if(i == 0){ allocs_after_first = counted_allocs; }
+		}
+		Tp(allocs_after_first > 0);
+		Tp(counted_allocs == allocs_after_first);
+		Tp(pool.retained > 0 && pool.retained <= pool.retain_limit);
+
+		// Over the retention limit blocks are freed
+		struct ArenaConfig cfg = { .capacity = 2 * 1024 * 1024, .pool = &pool };
+		struct ArenaAllocator ar = arena_create_ex(&cfg);
+		size_t retained = pool.retained;
+		arena_destroy(&ar);
+		Tp(pool.retained == retained);
+
+		arena_block_pool_drain(&pool);
+		Tp(pool.retained == 0);
+	}
+	Test_End();
+}
+
+int test_trim(){
+	Test_Begin("Trimming");
+	{
+		struct ArenaConfig cfg = { .capacity = 1024, .growth = { .kind = ARENA_GROWTH_FIXED, .size = 1024 } };
+		struct ArenaAllocator ar = arena_create_ex(&cfg);
+		fill_arena(&ar, 100, 100);
+		size_t blocks = arena_block_count(&ar);
+		Tp(blocks > 5);
+
+		arena_trim_pages(&ar, 2048);
+		Tp(arena_block_count(&ar) == blocks);
+
+		arena_trim(&ar, 2048);
+		Tp(arena_block_count(&ar) == 2);
+		Tp(arena_total_capacity(&ar) == 2048);
+		Tp(fill_arena(&ar, 100, 100));
+
+		arena_trim(&ar, 0);
+		Tp(arena_block_count(&ar) == 0);
+		Tp(fill_arena(&ar, 1, 100));
+		arena_destroy(&ar);
+	}
+	{
+		// Freeing the head must not leave the cursor behind in it
+		struct ArenaAllocator ar = arena_create(0, 0, 1024);
+		fill_arena(&ar, 100, 100);
+		arena_trim(&ar, 7168);
+		Tp(arena_block_count(&ar) > 0);
+		bool clean_ok = true;
+		for(struct ArenaBlock* b = ar.head; b != NULL; b = b->next){
+			clean_ok = clean_ok && b->clean <= b->capacity;
+		}
+		Tp(clean_ok);
+		Tp(ar.cursor == (uintptr_t)ar.head->data);
+		arena_destroy(&ar);
+	}
+	{   // Retaining reset
+		struct ArenaConfig cfg = {
+			.capacity = 1024,
+			.growth = { .kind = ARENA_GROWTH_FIXED, .size = 1024 },
+			.retain_bytes = 3000,
+		};
+		struct ArenaAllocator ar = arena_create_ex(&cfg);
+		fill_arena(&ar, 100, 100);
+		arena_reset(&ar);
+		Tp(arena_block_count(&ar) == 2);
+		Tp(ar.cursor == (uintptr_t)ar.head->data);
+		arena_destroy(&ar);
+	}
+#ifdef ARENA_VIRTUAL_MEMORY
+	{
+		struct ArenaAllocator ar = arena_create_virtual(16 * 1024 * 1024, 4096);
+		arena_alloc(&ar, char, 1024 * 1024);
+		arena_trim(&ar, 10000);
+		Tp(arena_total_capacity(&ar) == 12288);
+		arena_destroy(&ar);
+	}
+#endif
+	Test_End();
+}
+
+int test_realloc(){
+	Test_Begin("Realloc");
+	{
+		struct ArenaAllocator ar = arena_create(0, 0, 1024);
+		int* a = arena_alloc(&ar, int, 10);
+		for(int i = 0; i < 10; i += 1){ a[i] = i; }
+
+		// Last allocation grows and shrinks in place
+		int* b = arena_realloc(&ar, a, 10 * sizeof(int), 100 * sizeof(int), alignof(int));
+		Tp(b == a);
+		Tp(ar.cursor == (uintptr_t)(a + 100));
+		arena_shrink(&ar, b, 100 * sizeof(int), 20 * sizeof(int));
+		Tp(ar.cursor == (uintptr_t)(a + 20));
+
+		// Not the last one anymore, gets copied
+		int* other = arena_alloc(&ar, int, 1);
+		int* c = arena_realloc(&ar, b, 20 * sizeof(int), 40 * sizeof(int), alignof(int));
+		Tp(c != b && c > other);
+		Tp(c[9] == 9);
+
+		// Does not fit in the head anymore
+		int* d = arena_realloc(&ar, c, 40 * sizeof(int), 1000 * sizeof(int), alignof(int));
+		Tp(d != NULL && d != c && d[9] == 9);
+		Tp(arena_block_count(&ar) == 2);
+
+		Tp(arena_realloc(&ar, NULL, 0, 8, 8) != NULL);
+		arena_destroy(&ar);
+	}
+	Test_End();
+}
+
+int test_array(){
+	Test_Begin("ArenaArray");
+	{
+		typedef ArenaArray(int) IntArray;
+		struct ArenaAllocator ar = arena_create(0, 0, 64 * 1024);
+		IntArray arr;
+		arena_array_init(&arr, &ar, int);
+
+		bool ok = true;
+		for(int i = 0; i < 1000; i += 1){
+			ok = ok && arena_array_push(&arr, i);
+		}
+		Tp(ok);
+		Tp(arr.len == 1000 && arr.data[500] == 500);
+
+		// Most recent allocation, grows in place
+		int* before = arr.data;
+		int more[3] = {7, 8, 9};
+		Tp(arena_array_push_n(&arr, more, 3));
+		size_t extra = arr.cap - arr.len + 100;
+		Tp(arena_array_reserve(&arr, extra));
+		Tp(arr.data == before);
+		Tp(arr.data[1002] == 9);
+
+		// Something else got allocated after it, has to move
+		arena_alloc(&ar, char, 1);
+		extra = arr.cap - arr.len + 1;
+		Tp(arena_array_reserve(&arr, extra));
+		Tp(arr.data != before && arr.data[1001] == 8);
+		Tp(arena_array_pop(&arr) == 9);
+		arena_destroy(&ar);
+	}
+	{
+		// Over aligned elements keep their alignment through growth
+		struct Vec8 { _Alignas(32) float v[8]; };
+		typedef ArenaArray(struct Vec8) Vec8Array;
+		struct ArenaAllocator ar = arena_create(0, 0, 4096);
+		Vec8Array arr;
+		arena_array_init(&arr, &ar, struct Vec8);
+
+		bool aligned = true;
+		for(int i = 0; i < 200; i += 1){
+			arena_alloc(&ar, char, 1); // Breaks in place growth, forces moves
+			struct Vec8 x = { .v = { (float)i } };
+			aligned = aligned && arena_array_push(&arr, x) && ((uintptr_t)arr.data % 32 == 0);
+		}
+		Tp(aligned && arr.data[199].v[0] == 199.0f);
+		arena_destroy(&ar);
+	}
+	{
+		// Large elements only get their own alignment, not their size's
+		struct Page { char bytes[4096]; };
+		typedef ArenaArray(struct Page) PageArray;
+		struct ArenaAllocator ar = arena_create(0, 0, 64 * 1024);
+		arena_alloc(&ar, char, 1);
+		uintptr_t before = ar.cursor;
+		PageArray arr;
+		arena_array_init(&arr, &ar, struct Page);
+		Tp(arena_array_reserve(&arr, 1));
+		Tp((uintptr_t)arr.data == before);
+		arena_destroy(&ar);
+	}
+	Test_End();
+}
+
+int test_strings(){
+	Test_Begin("Strings");
+	{
+		struct ArenaAllocator ar = arena_create(0, 0, 4096);
+		struct ArenaStringBuilder sb;
+		arena_sb_init(&sb, &ar);
+
+		Tp(arena_sb_append(&sb, "Hello", 5));
+		Tp(arena_sb_appendf(&sb, ", %s #%d", "world", 42));
+		struct ArenaString parts[] = { {"a", 1}, {"bc", 2}, {"d", 1} };
+		Tp(arena_sb_join(&sb, parts, 3, ", ", 2));
+		struct ArenaString str = arena_sb_finish(&sb);
+		Tp(str.data != NULL && strcmp(str.data, "Hello, world #42a, bc, d") == 0);
+		Tp(str.len == strlen(str.data));
+		Tp(ar.cursor == (uintptr_t)(str.data + str.len + 1));
+
+		// Long enough that formatting has to retry
+		arena_sb_appendf(&sb, "%5000d", 7);
+		str = arena_sb_finish(&sb);
+		Tp(str.len == 5000 && str.data[4999] == '7');
+
+		struct ArenaInterner in;
+		arena_interner_init(&in, &ar);
+		struct ArenaSymbol foo = arena_intern(&in, "foo", 3);
+		char buf[] = "foo";
+		struct ArenaSymbol foo2 = arena_intern(&in, buf, 3);
+		struct ArenaSymbol bar = arena_intern(&in, "bar", 3);
+		Tp(foo.str != NULL && foo.str == foo2.str && foo.str != buf);
+		Tp(bar.str != foo.str && foo.hash == arena_hash_bytes("foo", 3));
+
+		bool ok = true;
+		char name[32];
+		for(int i = 0; i < 1000; i += 1){
+			int n = snprintf(name, sizeof(name), "sym%d", i % 500);
+			struct ArenaSymbol s = arena_intern(&in, name, n);
+			ok = ok && (s.str != NULL) && (strcmp(s.str, name) == 0);
+		}
+		Tp(ok);
+		Tp(in.count == 502);
+		Tp(arena_intern(&in, "foo", 3).str == foo.str);
+		arena_destroy(&ar);
+	}
+	Test_End();
+}
+
+int test_map(){
+	Test_Begin("Hash Map");
+	{
+		struct ArenaAllocator ar = arena_create(0, 0, 4096);
+		struct ArenaMap m;
+		arena_map_init_typed(&m, &ar, int, double);
+		int missing = 1;
+		Tp(arena_map_get(&m, &missing) == NULL);
+
+		bool ok = true;
+		for(int i = 0; i < 10000; i += 1){
+			bool inserted = false;
+			double* v = arena_map_put(&m, &i, &inserted);
+			ok = ok && v != NULL && inserted;
+			if(v){ *v = i * 0.5; }
+		}
+		Tp(ok);
+		Tp(m.len == 10000);
+
+		ok = true;
+		for(int i = 0; i < 10000; i += 1){
+			double* v = arena_map_get(&m, &i);
+			ok = ok && v != NULL && *v == i * 0.5;
+		}
+		Tp(ok);
+
+		// Remove the odd ones
+		ok = true;
+		for(int i = 1; i < 10000; i += 2){
+			ok = ok && arena_map_remove(&m, &i);
+		}
+		Tp(ok);
+		Tp(m.len == 5000);
+		Tp(!arena_map_remove(&m, &missing));
+
+		ok = true;
+		for(int i = 0; i < 10000; i += 1){
+			double* v = arena_map_get(&m, &i);
+			ok = ok && ((i % 2 == 0) ? (v != NULL && *v == i * 0.5) : (v == NULL));
+		}
+		Tp(ok);
+
+		bool inserted = true;
+		int two = 2;
+		Tp(arena_map_put(&m, &two, &inserted) != NULL && !inserted);
+
+		// Churn through tombstones without growing forever
+		size_t cap = m.cap;
+		ok = true;
+		for(int round = 0; round < 50; round += 1){
+			for(int i = 20000; i < 21000; i += 1){
+				ok = ok && arena_map_put(&m, &i, NULL) != NULL;
+			}
+			for(int i = 20000; i < 21000; i += 1){
+				ok = ok && arena_map_remove(&m, &i);
+			}
+		}
+		Tp(ok);
+		Tp(m.cap == cap);
+		arena_destroy(&ar);
+	}
+	Test_End();
+}
+
+int test_pool(){
+	Test_Begin("Object Pool");
+	{
+		struct ArenaAllocator ar = arena_create(0, 0, 64 * 1024);
+		struct ArenaPool pool = arena_pool_init(&ar, 24, 8);
+		void* objs[100];
+
+		bool ok = true;
+		for(int i = 0; i < 100; i += 1){
+			objs[i] = arena_pool_alloc(&pool);
+			ok = ok && objs[i] != NULL && ((uintptr_t)objs[i] % 8 == 0);
+			if(i > 0){ ok = ok && objs[i] != objs[i - 1]; }
+		}
+		Tp(ok);
+
+		// Freed objects come back without touching the arena
+		uintptr_t cursor = ar.cursor;
+		for(int i = 0; i < 50; i += 1){
+			arena_pool_free(&pool, objs[i]);
+		}
+		Tp(arena_pool_alloc(&pool) == objs[49]);
+		ok = true;
+		for(int i = 0; i < 49; i += 1){
+			ok = ok && arena_pool_alloc(&pool) != NULL;
+		}
+		Tp(ok);
+		Tp(ar.cursor == cursor);
+
+		// Reset drops the free list
+		arena_pool_free(&pool, objs[60]);
+		arena_reset(&ar);
+		Tp(arena_pool_alloc(&pool) == (void*)ar.head->data);
+		arena_destroy(&ar);
+	}
+	{
+		// Scopes between alloc and free don't make the pool churn
+		struct ArenaAllocator ar = arena_create(0, 0, 4096);
+		struct ArenaPool pool = arena_pool_init(&ar, 24, 8);
+		size_t capacity = arena_total_capacity(&ar);
+		for(int i = 0; i < 1000; i += 1){
+			void* obj = arena_pool_alloc(&pool);
+			struct ArenaMark mark = arena_mark(&ar);
+			arena_alloc(&ar, char, 32);
+			arena_rewind(&ar, mark);
+			arena_pool_free(&pool, obj);
+		}
+		Tp(arena_block_count(&ar) == 1 && arena_total_capacity(&ar) == capacity);
+
+		// Rewinding past a refill drops the free list, live objects from before
+		// the mark can still be freed
+		void* live = arena_pool_alloc(&pool);
+		struct ArenaMark mark = arena_mark(&ar);
+		struct ArenaPool other = arena_pool_init(&ar, 16, 8);
+		Tp(arena_pool_alloc(&other) != NULL);
+		arena_rewind(&ar, mark);
+		Tp(arena_pool_alloc(&other) == (void*)mark.cursor);
+		arena_pool_free(&pool, live);
+		Tp(arena_pool_alloc(&pool) == live);
+		arena_destroy(&ar);
+	}
+	Test_End();
+}
+
+int test_slab(){
+	Test_Begin("Slab Allocator");
+	{
+		struct ArenaAllocator ar = arena_create(0, 0, 1024 * 1024);
+		struct ArenaSlab slab;
+		arena_slab_init(&slab, &ar);
+
+		size_t sizes[] = {1, 16, 17, 100, 500, 2048, 3000};
+		void* ptrs[7];
+		bool ok = true;
+		for(int i = 0; i < 7; i += 1){
+			ptrs[i] = arena_slab_alloc(&slab, sizes[i]);
+			ok = ok && ptrs[i] != NULL && ((uintptr_t)ptrs[i] % alignof(max_align_t) == 0);
+			if(ptrs[i]){ memset(ptrs[i], i, sizes[i]); }
+		}
+		Tp(ok);
+
+		// Same class comes back after a free
+		arena_slab_free(&slab, ptrs[3]);
+		Tp(arena_slab_alloc(&slab, 110) == ptrs[3]);
+
+		// Large allocation that is the most recent one gives its memory back
+		uintptr_t cursor = ar.cursor;
+		void* big = arena_slab_alloc(&slab, 10000);
+		Tp(big != NULL && ar.cursor > cursor);
+		arena_slab_free(&slab, big);
+		Tp(ar.cursor - cursor < alignof(max_align_t));
+
+		unsigned char* grown = arena_slab_realloc(&slab, ptrs[4], 1000);
+		Tp(grown != NULL && grown != ptrs[4] && grown[499] == 4);
+		Tp(arena_slab_realloc(&slab, grown, 10) == grown);
+		arena_slab_free(&slab, NULL);
+		arena_destroy(&ar);
+	}
+	Test_End();
+}
+
+// Appends the id in *obj to a log, to check the order finalizers run in
+static int finalized[16];
+static int finalized_count = 0;
+
+static void log_finalizer(void* obj){
+	finalized[finalized_count++] = *(int*)obj;
+}
+
+int test_finalizers(){
+	Test_Begin("Finalizers");
+	{
+		struct ArenaAllocator ar = arena_create(0, 0, 256);
+		for(int i = 0; i < 3; i += 1){
+			int* id = arena_alloc(&ar, int, 1);
+			*id = i;
+			arena_add_finalizer(&ar, log_finalizer, id);
+		}
+		struct ArenaMark mark = arena_mark(&ar);
+		for(int i = 3; i < 5; i += 1){
+			int* id = arena_alloc(&ar, int, 1);
+			*id = i;
+			arena_add_finalizer(&ar, log_finalizer, id);
+			fill_arena(&ar, 10, 100); // Push the next one to a new block
+		}
+
+		arena_rewind(&ar, mark);
+		Tp(finalized_count == 2 && finalized[0] == 4 && finalized[1] == 3);
+		Tp(ar.finalizers == mark.finalizers);
+
+		arena_reset(&ar);
+		Tp(finalized_count == 5 && finalized[2] == 2 && finalized[4] == 0);
+		Tp(ar.finalizers == NULL);
+
+		int* id = arena_alloc(&ar, int, 1);
+		*id = 7;
+		Tp(arena_add_finalizer(&ar, log_finalizer, id));
+		arena_destroy(&ar);
+		Tp(finalized_count == 6 && finalized[5] == 7);
+	}
+	Test_End();
+}
+
+int test_alignment(){
+	Test_Begin("Alignment");
+	{
+		struct ArenaAllocator ar = arena_create(0, 0, 4096);
+		arena_alloc(&ar, char, 3);
+		double* d = arena_alloc_aligned(&ar, double, 4, 64);
+		Tp(((uintptr_t)d & 63) == 0);
+		// Never below the type's own alignment
+		arena_alloc(&ar, char, 1);
+		double* small = arena_alloc_aligned(&ar, double, 1, 1);
+		Tp(((uintptr_t)small & (alignof(double) - 1)) == 0);
+
+		Tp(align_forward_ptr(17, 16) == 32 && align_forward_ptr(32, 16) == 32);
+		Tp(align_forward_size(SIZE_MAX - 3, 8) == SIZE_MAX);
+
+		// Invalid alignments are only rejected in release builds once the
+		// head is full, the fast path has nothing but ARENA_ASSERT
+		Tp(arena_alloc_slow(&ar, 8, 24) == NULL);
+		Tp(arena_alloc_slow(&ar, 8, 0) == NULL);
+		arena_destroy(&ar);
+	}
+	Test_End();
+}
+
+int test_batch(){
+	Test_Begin("Batch Allocation");
+	{
+		struct ArenaAllocator ar = arena_create(0, 0, 4096);
+		arena_alloc(&ar, char, 1);
+
+		struct ArenaAllocDesc descs[] = {
+			arena_desc(double, 10),
+			arena_desc(char, 3),
+			{ sizeof(float) * 16, 64 },
+		};
+		void* out[3];
+		uintptr_t before = ar.cursor;
+		Tp(arena_alloc_batch(&ar, descs, 3, out));
+		Tp((char*)out[1] == (char*)out[0] + 80);
+		Tp(((uintptr_t)out[2] & 63) == 0 && (uintptr_t)out[2] + 64 == ar.cursor);
+		Tp(ar.cursor - before < 80 + 3 + 64 + 2 * 64);
+
+		descs[1].align = 3;
+		Tp(!arena_alloc_batch(&ar, descs, 3, out));
+
+		struct { float* x; float* y; uint8_t* flags; double* mass; } soa;
+		Tp(arena_alloc_soa(&ar, 100, 32, arena_column(soa.x, float), arena_column(soa.y, float),
+			arena_column(soa.flags, uint8_t), arena_column(soa.mass, double)));
+		Tp(((uintptr_t)soa.x & 31) == 0 && ((uintptr_t)soa.mass & 31) == 0);
+		Tp((char*)soa.y == (char*)soa.x + 416 && (char*)soa.mass >= (char*)soa.flags + 100);
+		soa.mass[99] = 1.0;
+		Tp((uintptr_t)(soa.mass + 100) == ar.cursor);
+
+		size_t lengths[] = { 3, 0, 5 };
+		int** rows = arena_alloc_jagged(&ar, int, lengths, 3);
+		Tp(rows != NULL && rows[1] == rows[0] + 3 && rows[2] == rows[0] + 3);
+		Tp((uintptr_t)(rows[2] + 5) == ar.cursor && (void*)rows[0] == (void*)(rows + 3));
+		rows[2][4] = 7;
+		Tp(arena_block_count(&ar) == 1);
+		arena_destroy(&ar);
+	}
+	{
+		// Columns are padded for their element's alignment, not its size
+		struct Page { char bytes[4096]; };
+		struct { char* tag; struct Page* page; } big;
+		struct ArenaAllocator ar = arena_create(0, 0, 64 * 1024);
+		Tp(arena_alloc_soa(&ar, 3, 1, arena_column(big.tag, char), arena_column(big.page, struct Page)));
+		Tp((char*)big.page == big.tag + 3);
+		arena_destroy(&ar);
+	}
+	Test_End();
+}
+
+// Claims its memory is zeroed but fills it with garbage, shows which bytes
+// arena_alloc_zeroed() trusts to be zero already
+static void* garbage_mem_alloc(void* impl_data, size_t n){
+	(void)impl_data;
+	void* p = malloc(n);
+	if(p != NULL){ memset(p, 0xCD, n); }
+	return p;
+}
+
+static bool all_bytes(unsigned char const* p, size_t n, unsigned char v){
+	for(size_t i = 0; i < n; i += 1){
+		if(p[i] != v){ return false; }
+	}
+	return true;
+}
+
+int test_zeroed(){
+	Test_Begin("Zeroed Allocation");
+	{
+		// Unknown memory is always cleared
+		struct ArenaAllocator ar = arena_create(0, 0, 4096);
+		Tp(ar.head->clean == ar.head->capacity);
+		unsigned char* p = arena_alloc(&ar, unsigned char, 256);
+		memset(p, 0xAA, 256);
+		arena_reset(&ar);
+		p = arena_calloc(&ar, unsigned char, 256);
+		Tp(all_bytes(p, 256, 0));
+		arena_destroy(&ar);
+	}
+	{
+		struct ArenaConfig cfg = {
+			.mem_alloc = garbage_mem_alloc,
+			.capacity = 4096,
+			.mem_zeroed = true,
+		};
+		struct ArenaAllocator ar = arena_create_ex(&cfg);
+		Tp(ar.head->clean == 0);
+
+		// Fresh memory is trusted and left alone
+		unsigned char* p = arena_alloc_zeroed(&ar, 64, 1);
+		Tp(all_bytes(p, 64, 0xCD));
+
+		// Memory given back by a rewind or a shrink is cleared
+		struct ArenaMark mark = arena_mark(&ar);
+		p = arena_alloc(&ar, unsigned char, 100);
+		memset(p, 0xAA, 100);
+		arena_rewind(&ar, mark);
+		Tp(ar.head->clean == 164);
+		p = arena_alloc_zeroed(&ar, 200, 1);
+		Tp(all_bytes(p, 100, 0) && all_bytes(p + 100, 100, 0xCD));
+
+		arena_shrink(&ar, p, 200, 0);
+		Tp(ar.head->clean == 264);
+		p = arena_alloc_zeroed(&ar, 300, 1);
+		Tp(all_bytes(p, 200, 0) && all_bytes(p + 200, 100, 0xCD));
+
+		arena_reset_zero(&ar);
+		Tp(ar.head->clean == 0);
+		p = arena_alloc(&ar, unsigned char, 600);
+		Tp(all_bytes(p, 364, 0) && all_bytes(p + 364, 236, 0xCD));
+		arena_destroy(&ar);
+	}
+	{
+		// Trimming below the head's capacity frees the head, clearing
+		// afterwards stays inside the blocks that are left
+		struct ArenaAllocator ar = arena_create(0, 0, 1024);
+		for(int i = 0; i < 100; i += 1){
+			memset(arena_alloc(&ar, unsigned char, 100), 0xAA, 100);
+		}
+		arena_trim(&ar, 7168);
+		arena_reset_zero(&ar);
+		bool zeroed = arena_block_count(&ar) > 0;
+		for(struct ArenaBlock* b = ar.head; b != NULL; b = b->next){
+			zeroed = zeroed && b->clean == 0 && all_bytes(b->data, b->capacity, 0);
+		}
+		Tp(zeroed);
+		arena_destroy(&ar);
+
+		// Same for a reset that keeps a budget
+		struct ArenaConfig cfg = { .capacity = 1024, .retain_bytes = 7168 };
+		ar = arena_create_ex(&cfg);
+		for(int i = 0; i < 100; i += 1){
+			memset(arena_alloc(&ar, unsigned char, 100), 0xAA, 100);
+		}
+		arena_reset_zero(&ar);
+		zeroed = arena_block_count(&ar) > 0;
+		for(struct ArenaBlock* b = ar.head; b != NULL; b = b->next){
+			zeroed = zeroed && b->clean == 0 && all_bytes(b->data, b->capacity, 0);
+		}
+		Tp(zeroed);
+		arena_destroy(&ar);
+	}
+	{
+		// Finishing a string only counts what the builder wrote as dirty
+		struct ArenaConfig cfg = {
+			.mem_alloc = garbage_mem_alloc,
+			.capacity = 256,
+			.mem_zeroed = true,
+		};
+		struct ArenaAllocator ar = arena_create_ex(&cfg);
+		struct ArenaStringBuilder sb;
+		arena_sb_init(&sb, &ar);
+		Tp(arena_sb_appendf(&sb, "%d", 5));
+		struct ArenaString s = arena_sb_finish(&sb);
+		Tp(s.len == 1 && strcmp(s.data, "5") == 0);
+		Tp(ar.head->clean <= 2);
+		unsigned char* p = arena_alloc_zeroed(&ar, 64, 1);
+		Tp(all_bytes(p, 64, 0xCD));
+
+		// Same after a truncated format had to move to a new block
+		arena_sb_init(&sb, &ar);
+		char big[300];
+		memset(big, 'x', sizeof(big) - 1);
+		big[sizeof(big) - 1] = 0;
+		Tp(arena_sb_appendf(&sb, "%s", big));
+		s = arena_sb_finish(&sb);
+		Tp(s.len == sizeof(big) - 1 && s.data[0] == 'x' && s.data[s.len] == 0);
+		p = arena_alloc_zeroed(&ar, 64, 1);
+		Tp(all_bytes(p, 64, 0xCD));
+		arena_destroy(&ar);
+	}
+	{
+		// Pooled blocks keep their watermark for the next arena
+		struct ArenaBlockPool pool;
+		arena_block_pool_init(&pool, NULL, NULL, NULL, 1024 * 1024);
+		struct ArenaConfig cfg = { .capacity = 4096, .pool = &pool };
+		struct ArenaAllocator ar = arena_create_ex(&cfg);
+		ar.head->clean = 0; // Pretend it came zeroed
+		arena_alloc(&ar, char, 100);
+		arena_destroy(&ar);
+
+		ar = arena_create_ex(&cfg);
+		Tp(ar.head->clean == 100);
+		arena_destroy(&ar);
+		arena_block_pool_drain(&pool);
+	}
+#ifdef ARENA_VIRTUAL_MEMORY
+	{
+		struct ArenaAllocator ar = arena_create_virtual(64 * 1024 * 1024, 0);
+		unsigned char* p = arena_alloc(&ar, unsigned char, 1024 * 1024);
+		memset(p, 0xAA, 1024 * 1024);
+		arena_reset(&ar);
+		Tp(ar.vm_clean == 1024 * 1024);
+		p = arena_calloc(&ar, unsigned char, 2 * 1024 * 1024);
+		Tp(all_bytes(p, 2 * 1024 * 1024, 0));
+
+		memset(p, 0xAA, 2 * 1024 * 1024);
+		arena_reset_zero(&ar);
+		Tp(ar.vm_clean == 0);
+		p = arena_alloc(&ar, unsigned char, 2 * 1024 * 1024);
+		Tp(all_bytes(p, 2 * 1024 * 1024, 0));
+		arena_destroy(&ar);
+	}
+#endif
+	{
+		// Large dirty blocks of the default memory functions drop their pages
+		struct ArenaAllocator ar = arena_create(0, 0, 1024 * 1024);
+		unsigned char* p = arena_alloc(&ar, unsigned char, 1024 * 1024);
+		memset(p, 0xAA, 1024 * 1024);
+		arena_reset_zero(&ar);
+		Tp(ar.head->clean == 0);
+		p = arena_alloc(&ar, unsigned char, 1024 * 1024);
+		Tp(all_bytes(p, 1024 * 1024, 0));
+		arena_destroy(&ar);
+	}
+	Test_End();
+}
+
 int main(){
 	int res = test_arena();
+	res += test_growth();
+	res += test_virtual();
+	res += test_huge_pages();
+	res += test_mark();
+	res += test_scratch();
+	res += test_concurrent();
+	res += test_block_pool();
+	res += test_trim();
+	res += test_realloc();
+	res += test_array();
+	res += test_strings();
+	res += test_map();
+	res += test_pool();
+	res += test_slab();
+	res += test_finalizers();
+	res += test_alignment();
+	res += test_batch();
+	res += test_zeroed();
 	return res;
 }
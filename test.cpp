@@ -0,0 +1,258 @@
+#include "test_urself.h"
+#include "arena.hpp"
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <map>
+#include <deque>
+
+struct alignas(64) Wide { char bytes[64]; };
+
+// Whether p points into one of the arena's blocks
+static bool in_arena(ArenaAllocator const* ar, void const* p){
+	uintptr_t u = reinterpret_cast<uintptr_t>(p);
+	for(ArenaBlock const* blk = ar->head; blk != nullptr; blk = blk->next){
+		uintptr_t data = reinterpret_cast<uintptr_t>(blk->data);
+		if(u >= data && u < data + blk->capacity){ return true; }
+	}
+	return false;
+}
+
+int test_vector(){
+	Test_Begin("ArenaVector");
+	{
+		ArenaAllocator ar = arena_create(0, 0, 64 * 1024);
+		ArenaVector<int> v(&ar);
+		bool ok = true;
+		for(int i = 0; i < 1000; i += 1){
+			ok = ok && v.push(i);
+		}
+		Tp(ok);
+		Tp(v.size() == 1000 && v[999] == 999);
+
+		// Most recent allocation, grows in place
+		int* before = v.data();
+		int more[4] = {1, 2, 3, 4};
+		Tp(v.reserve(v.capacity() - v.size() + 10));
+		Tp(v.data() == before);
+		Tp(v.push_n(more, 4));
+		Tp(v[1003] == 4);
+
+		int sum = 0;
+		for(int x : v){ sum += x; }
+		Tp(sum == 999 * 1000 / 2 + 10);
+		Tp(v.pop() == 4);
+		arena_destroy(&ar);
+	}
+	{
+		// Over aligned elements keep their alignment through growth
+		ArenaAllocator ar = arena_create(0, 0, 4096);
+		ArenaVector<Wide> wide(&ar);
+		bool aligned = true;
+		for(int i = 0; i < 100; i += 1){
+			arena_alloc(&ar, char, 1); // Breaks in place growth, forces moves
+			aligned = aligned && wide.push(Wide{}) && reinterpret_cast<uintptr_t>(wide.data()) % 64 == 0;
+		}
+		Tp(aligned);
+		arena_destroy(&ar);
+	}
+	{
+		// Large elements are only padded for their own alignment
+		struct Page { char bytes[4096]; };
+		ArenaAllocator ar = arena_create(0, 0, 64 * 1024);
+		arena_alloc(&ar, char, 1);
+		uintptr_t before = ar.cursor;
+		ArenaVector<Page> pages(&ar);
+		Tp(pages.reserve(1));
+		Tp(reinterpret_cast<uintptr_t>(pages.data()) == before);
+		arena_destroy(&ar);
+	}
+	Test_End();
+}
+
+int test_pmr(){
+	Test_Begin("arena_resource");
+	{
+		ArenaAllocator ar = arena_create(0, 0, 64 * 1024);
+		arena_resource res(&ar);
+
+		{
+			std::pmr::vector<int> v(&res);
+			for(int i = 0; i < 1000; i += 1){ v.push_back(i); }
+			Tp(v[999] == 999);
+
+			std::pmr::unordered_map<int, std::pmr::string> m(&res);
+			for(int i = 0; i < 100; i += 1){
+				m.emplace(i, std::pmr::string(50, 'x'));
+			}
+			Tp(m.size() == 100 && m[7].size() == 50);
+		}
+
+		// Last allocation gets rolled back, older ones are left alone
+		void* p = res.allocate(64, 8);
+		void* q = res.allocate(64, 8);
+		res.deallocate(p, 64, 8);
+		Tp(ar.cursor == (uintptr_t)q + 64);
+		res.deallocate(q, 64, 8);
+		Tp(ar.cursor == (uintptr_t)p + 64);
+
+		// Zero bytes still gets its own pointer, failing throws
+		void* z = res.allocate(0, 8);
+		Tp(z != nullptr && res.allocate(0, 8) != z);
+		volatile size_t too_big = SIZE_MAX - 64;
+		bool threw = false;
+		try { (void)res.allocate(too_big, 8); } catch(std::bad_alloc const&){ threw = true; }
+		Tp(threw);
+
+		arena_resource same(&ar);
+		Tp(res == same);
+		Tp(res != *std::pmr::new_delete_resource());
+		arena_destroy(&ar);
+	}
+	Test_End();
+}
+
+int test_stl_allocator(){
+	Test_Begin("ArenaStlAllocator");
+	{
+		ArenaAllocator ar = arena_create(0, 0, 64 * 1024);
+		ArenaAllocator other = arena_create(0, 0, 64 * 1024);
+		ArenaStlAllocator<int> alloc(&ar);
+
+		{
+			std::vector<int, ArenaStlAllocator<int>> v(alloc);
+			for(int i = 0; i < 1000; i += 1){ v.push_back(i); }
+			Tp(v[999] == 999);
+
+			using Map = std::map<int, double, std::less<int>, ArenaStlAllocator<std::pair<int const, double>>>;
+			Map m(alloc);
+			for(int i = 0; i < 100; i += 1){ m[i] = i * 0.5; }
+			Tp(m.size() == 100 && m[10] == 5.0);
+
+			std::deque<long, ArenaStlAllocator<long>> d(alloc);
+			for(long i = 0; i < 1000; i += 1){ d.push_front(i); }
+			Tp(d.front() == 999 && d.back() == 0);
+
+			// Rebound copies share the arena
+			ArenaStlAllocator<double> rebound(alloc);
+			Tp(rebound == alloc);
+			Tp(alloc != ArenaStlAllocator<int>(&other));
+
+			// Assigned containers keep their own arena
+			ArenaStlAllocator<int> other_alloc(&other);
+			std::vector<int, ArenaStlAllocator<int>> w(other_alloc);
+			w = v;
+			Tp(w.get_allocator() == other_alloc && w[999] == 999);
+			Tp(in_arena(&other, w.data()));
+
+			std::vector<int, ArenaStlAllocator<int>> moved(v);
+			std::vector<int, ArenaStlAllocator<int>> z(other_alloc);
+			z = std::move(moved);
+			Tp(z.get_allocator() == other_alloc && z[999] == 999);
+			Tp(in_arena(&other, z.data()));
+		}
+		arena_destroy(&ar);
+		arena_destroy(&other);
+	}
+	Test_End();
+}
+
+static int destroyed = 0;
+
+struct Named {
+	std::string name;
+	explicit Named(char const* n) : name(n) {}
+	~Named(){ destroyed += 1; }
+};
+
+struct Point { int x, y; };
+
+int test_make(){
+	Test_Begin("arena_make");
+	{
+		ArenaAllocator ar = arena_create(0, 0, 4096);
+		Named* a = arena_make<Named>(&ar, "a string too long for the small string buffer");
+		Tp(a != nullptr && a->name.size() > 40);
+
+		// No finalizer for trivially destructible types
+		ArenaFinalizer* before = ar.finalizers;
+		Point* p = arena_make<Point>(&ar, Point{1, 2});
+		Tp(p->y == 2 && ar.finalizers == before);
+
+		ArenaMark mark = arena_mark(&ar);
+		arena_make<Named>(&ar, "b");
+		arena_make<Named>(&ar, "c");
+		arena_rewind(&ar, mark);
+		Tp(destroyed == 2);
+
+		arena_reset(&ar);
+		Tp(destroyed == 3);
+		arena_make<Named>(&ar, "d");
+		arena_destroy(&ar);
+		Tp(destroyed == 4);
+	}
+	Test_End();
+}
+
+int test_arena_class(){
+	Test_Begin("Arena class");
+	int before = destroyed;
+	{
+		Arena arena(4096);
+		ArenaSpan<int> ints = arena.alloc<int>(16);
+		Tp(ints.size() == 16 && ints.data() != nullptr);
+		for(int& i : ints){ i = 3; }
+		Tp(ints[15] == 3);
+
+		ArenaSpan<Wide> wide = arena.alloc<Wide>(2);
+		Tp(reinterpret_cast<uintptr_t>(wide.data()) % 64 == 0);
+		ArenaSpan<int> line = arena.alloc<int, 128>(4);
+		Tp(reinterpret_cast<uintptr_t>(line.data()) % 128 == 0);
+		Tp(arena.alloc<int>(SIZE_MAX / 2).empty());
+
+		{
+			Arena::Scope scope(arena);
+			arena.make<Named>("scoped");
+			arena.alloc<char>(100000);
+			Tp(arena_block_count(arena.get()) == 2);
+		}
+		Tp(destroyed == before + 1 && arena_block_count(arena.get()) == 1);
+
+		// Moving hands the blocks and finalizers over
+		arena.make<Named>("moved");
+		Arena moved(std::move(arena));
+		Tp(arena.get()->head == nullptr && moved.get()->finalizers != nullptr);
+		moved = Arena(1024);
+		Tp(destroyed == before + 2);
+
+		moved.make<Named>("destroyed with the arena");
+	}
+	Tp(destroyed == before + 3);
+	Test_End();
+}
+
+int test_soa(){
+	Test_Begin("arena_alloc_soa");
+	{
+		Arena arena(4096);
+		float* x = nullptr;
+		uint16_t* id = nullptr;
+		double* mass = nullptr;
+		Tp(arena_alloc_soa(arena.get(), 50, 64, x, id, mass));
+		Tp(reinterpret_cast<uintptr_t>(x) % 64 == 0 && reinterpret_cast<uintptr_t>(mass) % 64 == 0);
+		Tp(reinterpret_cast<char*>(id) == reinterpret_cast<char*>(x) + 256);
+		Tp(reinterpret_cast<uintptr_t>(mass + 50) == arena.get()->cursor);
+	}
+	Test_End();
+}
+
+int main(){
+	int res = test_vector();
+	res += test_pmr();
+	res += test_stl_allocator();
+	res += test_make();
+	res += test_arena_class();
+	res += test_soa();
+	return res;
+}